@@ -1,39 +1,72 @@
 #pragma once
 
-#include <algorithm>
-#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
-#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <VapourSynth.h>
 #include <VSHelper.h>
 
-#ifdef VS_TARGET_CPU_X86
-#include "vectorclass/vectorclass.h"
-#endif
+#include "TDeintModCore.hpp"
 
-struct TDeintModData {
+struct TDeintModStats {
+    std::atomic<int64_t> frames, time[stageCount];
+    std::vector<int> computed;
+    std::mutex computedMutex;
+
+    explicit TDeintModStats(const int numFields) : frames{}, time{}, computed(numFields) {}
+};
+
+enum TraceFilter {
+    traceCreateMMTop,
+    traceCreateMMBottom,
+    traceBuildMM,
+    traceFinal
+};
+
+// Spans of the getFrame activations of every internal filter, written out as Chrome trace JSON once the last filter is freed
+struct TDeintModTrace {
+    struct Span {
+        int filter, n, activationReason;
+        std::thread::id thread;
+        int64_t start, end;
+    };
+
+    const std::string path;
+    const VSAPI * vsapi;
+    const int64_t origin;
+    std::vector<Span> spans;
+    std::mutex spansMutex;
+
+    TDeintModTrace(const std::string & file, const VSAPI * api);
+    ~TDeintModTrace();
+};
+
+// Motion mask graph shared by the TDeintMod instances that have the same source and mask parameters
+struct TDeintModMaskGraph {
+    VSNodeRef * const mask;
+    const VSAPI * const vsapi;
+
+    TDeintModMaskGraph(VSNodeRef * node, const VSAPI * api) noexcept : mask{ node }, vsapi{ api } {}
+    ~TDeintModMaskGraph() { vsapi->freeNode(mask); }
+};
+
+struct TDeintModData : TDeintModCore {
     VSNodeRef * node, * node2, * propNode, * mask, * edeint;
     VSVideoInfo vi;
     const VSVideoInfo * viSaved;
-    int order, field, mode, length, mtype, ttype, mtqL, mthL, mtqC, mthC, nt, minthresh, maxthresh, cstr, athresh, metric, expand;
-    bool link, show, process[3];
-    int hShift[3], vShift[3], hHalf[3], vHalf[3], athresh6, athreshsq, widthPad, peak;
-    uint8_t * gvlut;
-    std::array<uint8_t, 64> vlut;
-    std::array<uint8_t, 16> tmmlut16;
+    int parity, masks;
+    // Widths of the borders left out of the processing, in the order of std.Crop: left, right, top, bottom. The core works on the picture
+    // inside them, so its width and height are those of the cropped picture while vi keeps the dimensions of the clip.
+    int crop[4];
+    bool sharedMask, sceneChange;
+    // Whether the mask graph was built for TDeintMod, whose mask building filter also applies the spatial check, expansion and linking
+    bool refineMask;
     const VSFormat * format;
-    void (*copyPad)(const VSFrameRef *, VSFrameRef *, const int, const int, const VSAPI *);
-    void (*threshMask)(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*motionMask)(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*andMasks)(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*combineMasks)(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*buildMask)(VSFrameRef **, VSFrameRef **, VSFrameRef *, const int, const int, const int, const int, const TDeintModData *, const VSAPI *);
-    void (*setMaskForUpsize)(VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*checkSpatial)(const VSFrameRef *, VSFrameRef *, const TDeintModData *, const VSAPI *);
-    void (*expandMask)(VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*linkMask)(VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*eDeint)(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const TDeintModData *, const VSAPI *);
-    void (*cubicDeint)(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const TDeintModData *, const VSAPI *);
-    void (*binaryMask)(const VSFrameRef *, VSFrameRef *, const TDeintModData *, const VSAPI *);
+    std::shared_ptr<TDeintModStats> stats;
+    std::shared_ptr<TDeintModTrace> trace;
+    std::shared_ptr<TDeintModMaskGraph> maskGraph;
 };
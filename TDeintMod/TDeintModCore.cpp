@@ -0,0 +1,1532 @@
+/*
+**   VapourSynth port by HolyWu
+**
+**                TDeinterlace v1.1 for Avisynth 2.5.x
+**
+**   TDeinterlace is a bi-directionally motion adaptive deinterlacer.
+**   It also uses a couple modified forms of ela interpolation which
+**   help to reduce "jaggy" edges in places where interpolation must
+**   be used. TDeinterlace currently supports YV12 and YUY2 colorspaces.
+**
+**   Copyright (C) 2004-2007 Kevin Stone
+**
+**                    TMM v1.0 for Avisynth 2.5.x
+**
+**   TMM builds a motion-mask for TDeint, which TDeint uses via
+**   its 'emask' parameter.  TMM can use fixed or per-pixel adaptive
+**   motion thresholds, as well as any length static period.  It
+**   checks backwards, across, and forwards when looking for motion.
+**
+**   Copyright (C) 2007 Kevin Stone
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+#include "TDeintModKernels.hpp"
+
+void tdmBitblt(void * dstp, const int dstStride, const void * srcp, const int srcStride, const size_t rowSize, const size_t height) noexcept {
+    if (height) {
+        if (srcStride == dstStride && srcStride == static_cast<int>(rowSize)) {
+            memcpy(dstp, srcp, rowSize * height);
+        } else {
+            const uint8_t * srcp8 = static_cast<const uint8_t *>(srcp);
+            uint8_t * dstp8 = static_cast<uint8_t *>(dstp);
+            for (size_t i = 0; i < height; i++) {
+                memcpy(dstp8, srcp8, rowSize);
+                srcp8 += srcStride;
+                dstp8 += dstStride;
+            }
+        }
+    }
+}
+
+bool tdmIsAligned(const TDMFrame & frame, const int numPlanes) noexcept {
+    for (int plane = 0; plane < numPlanes; plane++) {
+        if (reinterpret_cast<uintptr_t>(frame.ptr[plane]) % tdmFrameAlignment || frame.stride[plane] % tdmFrameAlignment)
+            return false;
+    }
+    return true;
+}
+
+//////////////////////////////////////////
+// TDeintMod
+
+#ifdef VS_TARGET_CPU_X86
+template<typename T1, typename T2, int step> extern void threshMask_sse2(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template<typename T1, typename T2, int step> extern void threshMask_avx2(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+template<typename T1, typename T2, int step> extern void motionMask_sse2(const TDMFrame &, const TDMFrame *, const TDMFrame &, const TDMFrame *, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template<typename T1, typename T2, int step> extern void motionMask_avx2(const TDMFrame &, const TDMFrame *, const TDMFrame &, const TDMFrame *, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+template<typename T1, typename T2, int step> extern void andMasks_sse2(const TDMFrame &, const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template<typename T1, typename T2, int step> extern void andMasks_avx2(const TDMFrame &, const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+template<typename T1, typename T2, int step> extern void combineMasks_sse2(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template<typename T1, typename T2, int step> extern void combineMasks_avx2(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+template<typename T1, typename T2, int step> extern void elaDeint_sse2(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+template<typename T1, typename T2, int step> extern void elaDeint_avx2(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+
+extern void selectGenericKernels_avx2(TDeintModCore *) noexcept;
+extern void selectGenericKernels_avx2(IsCombedCore *, const int) noexcept;
+extern void selectGenericKernels_avx512(TDeintModCore *) noexcept;
+extern void selectGenericKernels_avx512(IsCombedCore *, const int) noexcept;
+#endif
+
+#ifdef TDM_VECTOR_EXTENSIONS
+template<typename T> extern void threshMask_vector(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template<typename T> extern void motionMask_vector(const TDMFrame &, const TDMFrame *, const TDMFrame &, const TDMFrame *, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template<typename T> extern void andMasks_vector(const TDMFrame &, const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template<typename T> extern void combineMasks_vector(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template<typename T> extern void buildMask_vector(const TDMFrame *, const TDMFrame *, const TDMFrame &, const int, const int, const int, const int, int *, double *,
+                                                  const TDeintModCore *) noexcept;
+template<typename T> extern void eDeint_vector(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &,
+                                               const TDeintModCore *) noexcept;
+template<typename T> extern void cubicDeint_vector(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+template<typename T> extern void elaDeint_vector(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+#endif
+
+template<typename T, bool fixedQ, bool fixedH>
+static void threshMaskKernel_c(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    constexpr T peak = std::numeric_limits<T>::max();
+
+    const int width = src.width[plane];
+    const int height = src.height[plane];
+    const int srcStride = src.stride[plane] / sizeof(T);
+    const int dstStride = dst.stride[0] / sizeof(T);
+    const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+    T * TDM_RESTRICT dstp0 = reinterpret_cast<T *>(dst.ptr[0]);
+    T * TDM_RESTRICT dstp1 = dstp0 + dstStride * height;
+
+    const T * srcpp = srcp + srcStride;
+    const T * srcpn = srcpp;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            // mirror the horizontal neighbors at the left and right edges
+            const int xl = x ? x - 1 : 1;
+            const int xr = (x < width - 1) ? x + 1 : width - 2;
+            int min0 = peak, max0 = 0;
+            int min1 = peak, max1 = 0;
+            int at;
+
+            if (d->ttype == 0) { // 4 neighbors - compensated
+                if (srcpp[x] < min0)
+                    min0 = srcpp[x];
+                if (srcpp[x] > max0)
+                    max0 = srcpp[x];
+                if (srcp[xl] < min1)
+                    min1 = srcp[xl];
+                if (srcp[xl] > max1)
+                    max1 = srcp[xl];
+                if (srcp[xr] < min1)
+                    min1 = srcp[xr];
+                if (srcp[xr] > max1)
+                    max1 = srcp[xr];
+                if (srcpn[x] < min0)
+                    min0 = srcpn[x];
+                if (srcpn[x] > max0)
+                    max0 = srcpn[x];
+
+                const int atv = std::max((std::abs(srcp[x] - min0) + d->vHalf[plane]) >> d->vShift[plane], (std::abs(srcp[x] - max0) + d->vHalf[plane]) >> d->vShift[plane]);
+                const int ath = std::max((std::abs(srcp[x] - min1) + d->hHalf[plane]) >> d->hShift[plane], (std::abs(srcp[x] - max1) + d->hHalf[plane]) >> d->hShift[plane]);
+                at = std::max(atv, ath);
+            } else if (d->ttype == 1) { // 8 neighbors - compensated
+                if (srcpp[xl] < min0)
+                    min0 = srcpp[xl];
+                if (srcpp[xl] > max0)
+                    max0 = srcpp[xl];
+                if (srcpp[x] < min0)
+                    min0 = srcpp[x];
+                if (srcpp[x] > max0)
+                    max0 = srcpp[x];
+                if (srcpp[xr] < min0)
+                    min0 = srcpp[xr];
+                if (srcpp[xr] > max0)
+                    max0 = srcpp[xr];
+                if (srcp[xl] < min1)
+                    min1 = srcp[xl];
+                if (srcp[xl] > max1)
+                    max1 = srcp[xl];
+                if (srcp[xr] < min1)
+                    min1 = srcp[xr];
+                if (srcp[xr] > max1)
+                    max1 = srcp[xr];
+                if (srcpn[xl] < min0)
+                    min0 = srcpn[xl];
+                if (srcpn[xl] > max0)
+                    max0 = srcpn[xl];
+                if (srcpn[x] < min0)
+                    min0 = srcpn[x];
+                if (srcpn[x] > max0)
+                    max0 = srcpn[x];
+                if (srcpn[xr] < min0)
+                    min0 = srcpn[xr];
+                if (srcpn[xr] > max0)
+                    max0 = srcpn[xr];
+
+                const int atv = std::max((std::abs(srcp[x] - min0) + d->vHalf[plane]) >> d->vShift[plane], (std::abs(srcp[x] - max0) + d->vHalf[plane]) >> d->vShift[plane]);
+                const int ath = std::max((std::abs(srcp[x] - min1) + d->hHalf[plane]) >> d->hShift[plane], (std::abs(srcp[x] - max1) + d->hHalf[plane]) >> d->hShift[plane]);
+                at = std::max(atv, ath);
+            } else if (d->ttype == 2) { // 4 neighbors - not compensated
+                if (srcpp[x] < min0)
+                    min0 = srcpp[x];
+                if (srcpp[x] > max0)
+                    max0 = srcpp[x];
+                if (srcp[xl] < min0)
+                    min0 = srcp[xl];
+                if (srcp[xl] > max0)
+                    max0 = srcp[xl];
+                if (srcp[xr] < min0)
+                    min0 = srcp[xr];
+                if (srcp[xr] > max0)
+                    max0 = srcp[xr];
+                if (srcpn[x] < min0)
+                    min0 = srcpn[x];
+                if (srcpn[x] > max0)
+                    max0 = srcpn[x];
+
+                at = std::max(std::abs(srcp[x] - min0), std::abs(srcp[x] - max0));
+            } else if (d->ttype == 3) { // 8 neighbors - not compensated
+                if (srcpp[xl] < min0)
+                    min0 = srcpp[xl];
+                if (srcpp[xl] > max0)
+                    max0 = srcpp[xl];
+                if (srcpp[x] < min0)
+                    min0 = srcpp[x];
+                if (srcpp[x] > max0)
+                    max0 = srcpp[x];
+                if (srcpp[xr] < min0)
+                    min0 = srcpp[xr];
+                if (srcpp[xr] > max0)
+                    max0 = srcpp[xr];
+                if (srcp[xl] < min0)
+                    min0 = srcp[xl];
+                if (srcp[xl] > max0)
+                    max0 = srcp[xl];
+                if (srcp[xr] < min0)
+                    min0 = srcp[xr];
+                if (srcp[xr] > max0)
+                    max0 = srcp[xr];
+                if (srcpn[xl] < min0)
+                    min0 = srcpn[xl];
+                if (srcpn[xl] > max0)
+                    max0 = srcpn[xl];
+                if (srcpn[x] < min0)
+                    min0 = srcpn[x];
+                if (srcpn[x] > max0)
+                    max0 = srcpn[x];
+                if (srcpn[xr] < min0)
+                    min0 = srcpn[xr];
+                if (srcpn[xr] > max0)
+                    max0 = srcpn[xr];
+
+                at = std::max(std::abs(srcp[x] - min0), std::abs(srcp[x] - max0));
+            } else if (d->ttype == 4) { // 4 neighbors - not compensated (range)
+                if (srcpp[x] < min0)
+                    min0 = srcpp[x];
+                if (srcpp[x] > max0)
+                    max0 = srcpp[x];
+                if (srcp[xl] < min0)
+                    min0 = srcp[xl];
+                if (srcp[xl] > max0)
+                    max0 = srcp[xl];
+                if (srcp[x] < min0)
+                    min0 = srcp[x];
+                if (srcp[x] > max0)
+                    max0 = srcp[x];
+                if (srcp[xr] < min0)
+                    min0 = srcp[xr];
+                if (srcp[xr] > max0)
+                    max0 = srcp[xr];
+                if (srcpn[x] < min0)
+                    min0 = srcpn[x];
+                if (srcpn[x] > max0)
+                    max0 = srcpn[x];
+
+                at = max0 - min0;
+            } else { // 8 neighbors - not compensated (range)
+                if (srcpp[xl] < min0)
+                    min0 = srcpp[xl];
+                if (srcpp[xl] > max0)
+                    max0 = srcpp[xl];
+                if (srcpp[x] < min0)
+                    min0 = srcpp[x];
+                if (srcpp[x] > max0)
+                    max0 = srcpp[x];
+                if (srcpp[xr] < min0)
+                    min0 = srcpp[xr];
+                if (srcpp[xr] > max0)
+                    max0 = srcpp[xr];
+                if (srcp[xl] < min0)
+                    min0 = srcp[xl];
+                if (srcp[xl] > max0)
+                    max0 = srcp[xl];
+                if (srcp[x] < min0)
+                    min0 = srcp[x];
+                if (srcp[x] > max0)
+                    max0 = srcp[x];
+                if (srcp[xr] < min0)
+                    min0 = srcp[xr];
+                if (srcp[xr] > max0)
+                    max0 = srcp[xr];
+                if (srcpn[xl] < min0)
+                    min0 = srcpn[xl];
+                if (srcpn[xl] > max0)
+                    max0 = srcpn[xl];
+                if (srcpn[x] < min0)
+                    min0 = srcpn[x];
+                if (srcpn[x] > max0)
+                    max0 = srcpn[x];
+                if (srcpn[xr] < min0)
+                    min0 = srcpn[xr];
+                if (srcpn[xr] > max0)
+                    max0 = srcpn[xr];
+
+                at = max0 - min0;
+            }
+
+            if (!fixedQ)
+                dstp0[x] = (at + 2) >> 2;
+            if (!fixedH)
+                dstp1[x] = (at + 1) >> 1;
+        }
+
+        srcpp = srcp;
+        srcp = srcpn;
+        srcpn += (y < height - 2) ? srcStride : -srcStride;
+        dstp0 += dstStride;
+        dstp1 += dstStride;
+    }
+}
+
+template<typename T>
+static void threshMask_c(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    const bool fixedQ = (plane ? d->mtqC : d->mtqL) > -1;
+    const bool fixedH = (plane ? d->mthC : d->mthL) > -1;
+
+    if (fixedQ)
+        threshMaskKernel_c<T, true, false>(src, dst, plane, d);
+    else if (fixedH)
+        threshMaskKernel_c<T, false, true>(src, dst, plane, d);
+    else
+        threshMaskKernel_c<T, false, false>(src, dst, plane, d);
+}
+
+template<typename T, bool fixedQ, bool fixedH>
+static void motionMaskKernel_c(const TDMFrame & src1, const TDMFrame * msk1, const TDMFrame & src2, const TDMFrame * msk2, const TDMFrame & dst,
+                         const int plane, const TDeintModCore * d) noexcept {
+    constexpr T peak = std::numeric_limits<T>::max();
+
+    const int width = src1.width[plane];
+    const int height = src1.height[plane];
+    const int srcStride1 = src1.stride[plane] / sizeof(T);
+    const int srcStride2 = src2.stride[plane] / sizeof(T);
+    const int stride = dst.stride[0] / sizeof(T);
+    const T * srcp1 = reinterpret_cast<const T *>(src1.ptr[plane]);
+    const T * srcp2 = reinterpret_cast<const T *>(src2.ptr[plane]);
+    const T * mskp1q = (fixedQ && fixedH) ? nullptr : reinterpret_cast<const T *>(msk1->ptr[0]);
+    const T * mskp2q = (fixedQ && fixedH) ? nullptr : reinterpret_cast<const T *>(msk2->ptr[0]);
+    T * TDM_RESTRICT dstpq = reinterpret_cast<T *>(dst.ptr[0]);
+
+    const T * mskp1h = fixedH ? nullptr : mskp1q + stride * height;
+    const T * mskp2h = fixedH ? nullptr : mskp2q + stride * height;
+    T * TDM_RESTRICT dstph = dstpq + stride * height;
+
+    const int threshq = fixedQ ? std::min(std::max((plane ? d->mtqC : d->mtqL) + d->nt, d->minthresh), d->maxthresh) : 0;
+    const int threshh = fixedH ? std::min(std::max((plane ? d->mthC : d->mthL) + d->nt, d->minthresh), d->maxthresh) : 0;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const int diff = std::abs(srcp1[x] - srcp2[x]);
+            if (fixedQ)
+                dstpq[x] = (diff <= threshq) ? peak : 0;
+            else
+                dstpq[x] = (diff <= std::min(std::max(std::min(mskp1q[x], mskp2q[x]) + d->nt, d->minthresh), d->maxthresh)) ? peak : 0;
+            if (fixedH)
+                dstph[x] = (diff <= threshh) ? peak : 0;
+            else
+                dstph[x] = (diff <= std::min(std::max(std::min(mskp1h[x], mskp2h[x]) + d->nt, d->minthresh), d->maxthresh)) ? peak : 0;
+        }
+
+        srcp1 += srcStride1;
+        srcp2 += srcStride2;
+        if (!fixedQ) {
+            mskp1q += stride;
+            mskp2q += stride;
+        }
+        if (!fixedH) {
+            mskp1h += stride;
+            mskp2h += stride;
+        }
+        dstpq += stride;
+        dstph += stride;
+    }
+}
+
+template<typename T>
+static void motionMask_c(const TDMFrame & src1, const TDMFrame * msk1, const TDMFrame & src2, const TDMFrame * msk2, const TDMFrame & dst,
+                         const int plane, const TDeintModCore * d) noexcept {
+    const bool fixedQ = (plane ? d->mtqC : d->mtqL) > -1;
+    const bool fixedH = (plane ? d->mthC : d->mthL) > -1;
+
+    if (fixedQ && fixedH)
+        motionMaskKernel_c<T, true, true>(src1, msk1, src2, msk2, dst, plane, d);
+    else if (fixedQ)
+        motionMaskKernel_c<T, true, false>(src1, msk1, src2, msk2, dst, plane, d);
+    else if (fixedH)
+        motionMaskKernel_c<T, false, true>(src1, msk1, src2, msk2, dst, plane, d);
+    else
+        motionMaskKernel_c<T, false, false>(src1, msk1, src2, msk2, dst, plane, d);
+}
+
+template<typename T>
+static void andMasks_c(const TDMFrame & src1, const TDMFrame & src2, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    const int width = src1.width[0] >> (plane ? d->subSamplingW : 0);
+    const int height = src1.height[0] >> (plane ? d->subSamplingH : 0);
+    const int stride = src1.stride[0] / sizeof(T);
+    const T * srcp1 = reinterpret_cast<const T *>(src1.ptr[0]);
+    const T * srcp2 = reinterpret_cast<const T *>(src2.ptr[0]);
+    T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[0]);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++)
+            dstp[x] &= srcp1[x] & srcp2[x];
+
+        srcp1 += stride;
+        srcp2 += stride;
+        dstp += stride;
+    }
+}
+
+template<typename T>
+static void combineMasks_c(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    constexpr T peak = std::numeric_limits<T>::max();
+
+    const int width = dst.width[plane];
+    const int height = dst.height[plane];
+    const int srcStride = src.stride[0] / sizeof(T);
+    const int dstStride = dst.stride[plane] / sizeof(T);
+    const T * srcp0 = reinterpret_cast<const T *>(src.ptr[0]);
+    T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+    const T * srcpp0 = srcp0 + srcStride;
+    const T * srcpn0 = srcpp0;
+    const T * srcp1 = srcp0 + srcStride * height;
+
+    tdmBitblt(dstp, dst.stride[plane], srcp0, src.stride[0], width * sizeof(T), height);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (srcp0[x] || !srcp1[x])
+                continue;
+
+            const int xl = x ? x - 1 : 1;
+            const int xr = (x < width - 1) ? x + 1 : width - 2;
+            int count = 0;
+
+            if (srcpp0[xl])
+                count++;
+            if (srcpp0[x])
+                count++;
+            if (srcpp0[xr])
+                count++;
+            if (srcp0[xl])
+                count++;
+            if (srcp0[xr])
+                count++;
+            if (srcpn0[xl])
+                count++;
+            if (srcpn0[x])
+                count++;
+            if (srcpn0[xr])
+                count++;
+
+            if (count >= d->cstr)
+                dstp[x] = peak;
+        }
+
+        srcpp0 = srcp0;
+        srcp0 = srcpn0;
+        srcpn0 += (y < height - 2) ? srcStride : -srcStride;
+        srcp1 += srcStride;
+        dstp += dstStride;
+    }
+}
+
+static void selectFunctions(const unsigned opt, TDeintModCore * d) noexcept {
+    int tier = 1;
+#ifdef VS_TARGET_CPU_X86
+    const int iset = instrset_detect();
+    if ((opt == 0 && iset >= 10) || opt == 5)
+        tier = 5;
+    else if ((opt == 0 && iset >= 8) || opt == 3)
+        tier = 3;
+    else if ((opt == 0 && iset >= 2) || opt == 2)
+        tier = 2;
+#endif
+#ifdef TDM_VECTOR_EXTENSIONS
+    // Without the x86 kernels auto detection falls back to the portable ones
+    if (opt == 4 || (opt == 0 && tier == 1))
+        tier = 4;
+#endif
+    d->selectedOpt = tier;
+
+    selectGenericKernels(d);
+#ifdef VS_TARGET_CPU_X86
+    if (tier == 5)
+        selectGenericKernels_avx512(d);
+    else if (tier == 3)
+        selectGenericKernels_avx2(d);
+#endif
+
+    if (d->bitsPerSample <= 8) {
+        d->threshMask = threshMask_c<uint8_t>;
+        d->motionMask = motionMask_c<uint8_t>;
+        d->andMasks = andMasks_c<uint8_t>;
+        d->combineMasks = combineMasks_c<uint8_t>;
+
+#ifdef VS_TARGET_CPU_X86
+        if (tier == 3 || tier == 5) {
+            d->threshMask = threshMask_avx2<uint8_t, Vec32uc, 32>;
+            d->motionMask = motionMask_avx2<uint8_t, Vec32uc, 32>;
+            d->andMasks = andMasks_avx2<uint8_t, Vec32uc, 32>;
+            d->combineMasks = combineMasks_avx2<uint8_t, Vec32uc, 32>;
+            d->elaDeint = elaDeint_avx2<uint8_t, Vec32uc, 32>;
+        } else if (tier == 2) {
+            d->threshMask = threshMask_sse2<uint8_t, Vec16uc, 16>;
+            d->motionMask = motionMask_sse2<uint8_t, Vec16uc, 16>;
+            d->andMasks = andMasks_sse2<uint8_t, Vec16uc, 16>;
+            d->combineMasks = combineMasks_sse2<uint8_t, Vec16uc, 16>;
+            d->elaDeint = elaDeint_sse2<uint8_t, Vec16uc, 16>;
+        }
+#endif
+
+#ifdef TDM_VECTOR_EXTENSIONS
+        if (tier == 4) {
+            d->threshMask = threshMask_vector<uint8_t>;
+            d->motionMask = motionMask_vector<uint8_t>;
+            d->andMasks = andMasks_vector<uint8_t>;
+            d->combineMasks = combineMasks_vector<uint8_t>;
+            d->buildMask = buildMask_vector<uint8_t>;
+            d->eDeint = eDeint_vector<uint8_t>;
+            d->cubicDeint = cubicDeint_vector<uint8_t>;
+            d->elaDeint = elaDeint_vector<uint8_t>;
+        }
+#endif
+    } else {
+        d->threshMask = threshMask_c<uint16_t>;
+        d->motionMask = motionMask_c<uint16_t>;
+        d->andMasks = andMasks_c<uint16_t>;
+        d->combineMasks = combineMasks_c<uint16_t>;
+
+#ifdef VS_TARGET_CPU_X86
+        if (tier == 3 || tier == 5) {
+            d->threshMask = threshMask_avx2<uint16_t, Vec16us, 16>;
+            d->motionMask = motionMask_avx2<uint16_t, Vec16us, 16>;
+            d->andMasks = andMasks_avx2<uint16_t, Vec16us, 16>;
+            d->combineMasks = combineMasks_avx2<uint16_t, Vec16us, 16>;
+            d->elaDeint = elaDeint_avx2<uint16_t, Vec16us, 16>;
+        } else if (tier == 2) {
+            d->threshMask = threshMask_sse2<uint16_t, Vec8us, 8>;
+            d->motionMask = motionMask_sse2<uint16_t, Vec8us, 8>;
+            d->andMasks = andMasks_sse2<uint16_t, Vec8us, 8>;
+            d->combineMasks = combineMasks_sse2<uint16_t, Vec8us, 8>;
+            d->elaDeint = elaDeint_sse2<uint16_t, Vec8us, 8>;
+        }
+#endif
+
+#ifdef TDM_VECTOR_EXTENSIONS
+        if (tier == 4) {
+            d->threshMask = threshMask_vector<uint16_t>;
+            d->motionMask = motionMask_vector<uint16_t>;
+            d->andMasks = andMasks_vector<uint16_t>;
+            d->combineMasks = combineMasks_vector<uint16_t>;
+            d->buildMask = buildMask_vector<uint16_t>;
+            d->eDeint = eDeint_vector<uint16_t>;
+            d->cubicDeint = cubicDeint_vector<uint16_t>;
+            d->elaDeint = elaDeint_vector<uint16_t>;
+        }
+#endif
+    }
+}
+
+static inline int64_t stageClock(const int64_t * times) noexcept {
+    return times ? std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() : 0;
+}
+
+// Charges the time elapsed since start to a stage and returns the start of the next one
+static inline int64_t stageDone(int64_t * times, const int stage, const int64_t start) noexcept {
+    if (!times)
+        return 0;
+
+    const int64_t now = stageClock(times);
+    times[stage] += now - start;
+    return now;
+}
+
+// A view of the lines of one parity of a frame
+static TDMFrame fieldOf(const TDMFrame & frame, const int parity, const int numPlanes) noexcept {
+    TDMFrame field = frame;
+    for (int plane = 0; plane < numPlanes; plane++) {
+        field.ptr[plane] += frame.stride[plane] * parity;
+        field.stride[plane] *= 2;
+        field.height[plane] /= 2;
+    }
+    return field;
+}
+
+// Mean time of one run over a block of sustained work lasting at least duration nanoseconds
+template<typename F>
+static int64_t sustainedTime(F run, const int64_t duration) {
+    const auto start = std::chrono::steady_clock::now();
+    int64_t elapsed, runs = 0;
+    do {
+        run();
+        runs++;
+        elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < duration);
+    return elapsed / runs;
+}
+
+// With opt=-1, times every kernel tier the CPU supports on a synthetic clip as wide as the clip and keeps the fastest. Some CPUs run the SSE2
+// kernels faster than the AVX2 ones or the AVX2 ones faster than the AVX-512 builds (downclocking, split 256-bit units), which the
+// instruction set alone doesn't tell. Each tier runs the whole chain it switches, from the motion masks to the composition, after
+// a warm-up long enough for the clock to settle. The result only depends on the CPU and the sample, so it is measured once per
+// process for each bit depth.
+static void calibrate(TDeintModCore * d) {
+    std::vector<int> tiers{ 1 };
+#ifdef VS_TARGET_CPU_X86
+    const int iset = instrset_detect();
+    if (iset >= 2)
+        tiers.push_back(2);
+    if (iset >= 8)
+        tiers.push_back(3);
+#endif
+#ifdef TDM_VECTOR_EXTENSIONS
+    tiers.push_back(4);
+#endif
+#ifdef VS_TARGET_CPU_X86
+    if (iset >= 10)
+        tiers.push_back(5);
+#endif
+    if (tiers.size() < 2)
+        return;
+
+    static std::mutex calibrationMutex;
+    static int calibrated[2];
+
+    std::lock_guard<std::mutex> lock{ calibrationMutex };
+    int & best = calibrated[d->bitsPerSample > 8];
+
+    if (!best) {
+        // every stage a tier switches is enabled, whatever the clip uses
+        TDeintModCore c = *d;
+        c.analysis.reset();
+        c.height = std::min(d->height, 128) & ~3;
+        c.lumaMask = c.show = false;
+        c.link = !d->gray;
+        c.expand = 1;
+        c.athresh = 4 * d->peak / 255;
+        c.athresh6 = c.athresh * 6;
+        c.athreshsq = c.athresh * c.athresh;
+        std::fill_n(c.process, 3, true);
+        std::fill_n(c.fixedThresh, 3, false);
+
+        const int bytesPerSample = (d->bitsPerSample + 7) / 8;
+        const int fieldHeight = c.height / 2;
+
+        // Noise over a gradient in a checkerboard of blocks that change from frame to frame, so that every kernel sees static and
+        // moving areas. The fourth frame stands in for edeint.
+        std::unique_ptr<TDMBuffer> src[4], thresh[3], motion[2], motionMask[2];
+        TDMFrame srcFrames[4], threshFrames[3], motionFrames[2];
+        uint32_t seed = 0x9e3779b9;
+        for (int i = 0; i < 4; i++) {
+            src[i].reset(new TDMBuffer{ c.width, c.height, c.numPlanes, bytesPerSample, c.subSamplingW, c.subSamplingH });
+            srcFrames[i] = src[i]->frame();
+
+            for (int plane = 0; plane < c.numPlanes; plane++) {
+                for (int y = 0; y < srcFrames[i].height[plane]; y++) {
+                    uint8_t * line = srcFrames[i].ptr[plane] + srcFrames[i].stride[plane] * y;
+                    for (int x = 0; x < srcFrames[i].width[plane]; x++) {
+                        seed = seed * 1664525 + 1013904223;
+                        const int noise = ((x / 16 + y / 16) & 1) ? static_cast<int>((seed >> 24) * d->peak / 1020) : 0;
+                        const int value = std::min((x + y) * d->peak / 512 + noise, d->peak);
+                        if (bytesPerSample == 1)
+                            line[x] = value;
+                        else
+                            reinterpret_cast<uint16_t *>(line)[x] = value;
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < 3; i++) {
+            thresh[i].reset(new TDMBuffer{ c.width, fieldHeight * 2, 1, bytesPerSample, 0, 0 });
+            threshFrames[i] = thresh[i]->frame();
+        }
+        for (int i = 0; i < 2; i++) {
+            motion[i].reset(new TDMBuffer{ c.width, fieldHeight * 2, 1, bytesPerSample, 0, 0 });
+            motionFrames[i] = motion[i]->frame();
+            motionMask[i].reset(new TDMBuffer{ c.width, fieldHeight, c.numPlanes, bytesPerSample, c.subSamplingW, c.subSamplingH });
+        }
+        const TDMBuffer combined{ c.width, fieldHeight * 2, 1, bytesPerSample, 0, 0 };
+        const TDMBuffer mask{ c.width, c.height, c.numPlanes, bytesPerSample, c.subSamplingW, c.subSamplingH };
+        const TDMBuffer dst{ c.width, c.height, c.numPlanes, bytesPerSample, c.subSamplingW, c.subSamplingH };
+
+        int tStart, tStop, bStart, bStop;
+        tdmMaskWindow(c.length, c.order, 1, &c, &tStart, &tStop, &bStart, &bStop);
+        const std::vector<TDMFrame> cSrc(bStop - bStart + 1, motionMask[1]->frame()), oSrc(tStop - tStart + 1, motionMask[0]->frame());
+
+        const auto run = [&] {
+            for (int parity = 0; parity < 2; parity++) {
+                TDMFrame fields[3];
+                for (int i = 0; i < 3; i++)
+                    fields[i] = fieldOf(srcFrames[i], parity, c.numPlanes);
+                tdmCreateMotionMask(&c, fields, threshFrames, motionFrames, combined.frame(), motionMask[parity]->frame(), nullptr);
+            }
+
+            int summary;
+            double ratio[3];
+            tdmBuildMask(&c, cSrc.data(), oSrc.data(), static_cast<int>(cSrc.size()), static_cast<int>(oSrc.size()), c.order, 1, mask.frame(),
+                         nullptr, &summary, ratio);
+            tdmRefineMask(&c, srcFrames[1], &mask.frame(), 1, ratio);
+
+            for (c.type = 0; c.type < 2; c.type++)
+                tdmComposeFrame(&c, dst.frame(), &mask.frame(), &srcFrames[0], srcFrames[1], &srcFrames[2], nullptr, 1, maskMixed);
+            tdmComposeFrame(&c, dst.frame(), &mask.frame(), &srcFrames[0], srcFrames[1], &srcFrames[2], &srcFrames[3], 1, maskMixed);
+            tdmComposeFrame(&c, dst.frame(), &mask.frame(), nullptr, srcFrames[1], nullptr, nullptr, 1, maskAllMoving);
+        };
+
+        int64_t fastest = std::numeric_limits<int64_t>::max();
+        for (const int tier : tiers) {
+            selectFunctions(tier, &c);
+
+            // the warm-up lets the clock settle on the frequency the tier sustains, then the fastest of a few blocks is kept
+            sustainedTime(run, 10000000);
+            int64_t time = std::numeric_limits<int64_t>::max();
+            for (int block = 0; block < 4; block++)
+                time = std::min(time, sustainedTime(run, 5000000));
+
+            if (time < fastest) {
+                fastest = time;
+                best = tier;
+            }
+        }
+    }
+
+    selectFunctions(best, d);
+}
+
+void tdmSetDefaults(TDeintModCore * d) noexcept {
+    d->order = 0;
+    d->field = -1;
+    d->mode = 0;
+    d->length = 10;
+    d->lookahead = -1;
+    d->mtype = 1;
+    d->ttype = 1;
+    d->mtqL = d->mthL = d->mtqC = d->mthC = -1;
+    d->nt = 2;
+    d->minthresh = 4;
+    d->maxthresh = 75;
+    d->cstr = 4;
+    d->mres = 0;
+    d->athresh = -1;
+    d->metric = 0;
+    d->expand = 0;
+    d->type = 0;
+    d->opt = 0;
+    d->link = true;
+    d->show = false;
+    d->lumaMask = false;
+    d->reduce = false;
+    d->process[0] = d->process[1] = d->process[2] = true;
+}
+
+void tdmSetCrop(TDeintModCore * d, const int * crop) {
+    for (int i = 0; i < 4; i++) {
+        if (crop[i] < 0)
+            throw std::string{ "crop values must be greater than or equal to 0" };
+    }
+
+    // the borders must keep the chroma aligned and, at the top and bottom, the field parity of the lines
+    const int alignW = 1 << d->subSamplingW;
+    const int alignH = 2 << d->subSamplingH;
+    if (crop[0] % alignW || crop[1] % alignW)
+        throw std::string{ "left and right crop must be multiples of " + std::to_string(alignW) };
+    if (crop[2] % alignH || crop[3] % alignH)
+        throw std::string{ "top and bottom crop must be multiples of " + std::to_string(alignH) };
+
+    d->width -= crop[0] + crop[1];
+    d->height -= crop[2] + crop[3];
+    if (d->width <= 0 || d->height <= 0)
+        throw std::string{ "crop leaves no picture" };
+}
+
+TDMFrame tdmCropView(const TDeintModCore * d, TDMFrame frame, const int * crop) noexcept {
+    const int bytesPerSample = (d->bitsPerSample + 7) / 8;
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        const int ssW = plane ? d->subSamplingW : 0;
+        const int ssH = plane ? d->subSamplingH : 0;
+        frame.ptr[plane] += frame.stride[plane] * (crop[2] >> ssH) + (crop[0] >> ssW) * bytesPerSample;
+        frame.width[plane] -= (crop[0] + crop[1]) >> ssW;
+        frame.height[plane] -= (crop[2] + crop[3]) >> ssH;
+    }
+    return frame;
+}
+
+void tdmInit(TDeintModCore * d) {
+    if (d->order < 0 || d->order > 1)
+        throw std::string{ "order must be 0 or 1" };
+
+    if (d->field < -1 || d->field > 1)
+        throw std::string{ "field must be -1, 0 or 1" };
+
+    if (d->mode < 0 || d->mode > 1)
+        throw std::string{ "mode must be 0 or 1" };
+
+    if (d->length < 6)
+        throw std::string{ "length must be greater than or equal to 6" };
+
+    if (d->lookahead < -1)
+        throw std::string{ "lookahead must be greater than or equal to -1" };
+
+    if (d->mtype < 0 || d->mtype > 2)
+        throw std::string{ "mtype must be 0, 1 or 2" };
+
+    if (d->ttype < 0 || d->ttype > 5)
+        throw std::string{ "ttype must be 0, 1, 2, 3, 4 or 5" };
+
+    if (d->mtqL < -2 || d->mtqL > 255)
+        throw std::string{ "mtql must be between -2 and 255 (inclusive)" };
+
+    if (d->mthL < -2 || d->mthL > 255)
+        throw std::string{ "mthl must be between -2 and 255 (inclusive)" };
+
+    if (d->mtqC < -2 || d->mtqC > 255)
+        throw std::string{ "mtqc must be between -2 and 255 (inclusive)" };
+
+    if (d->mthC < -2 || d->mthC > 255)
+        throw std::string{ "mthc must be between -2 and 255 (inclusive)" };
+
+    if (d->nt < 0 || d->nt > 255)
+        throw std::string{ "nt must be between 0 and 255 (inclusive)" };
+
+    if (d->minthresh < 0 || d->minthresh > 255)
+        throw std::string{ "minthresh must be between 0 and 255 (inclusive)" };
+
+    if (d->maxthresh < 0 || d->maxthresh > 255)
+        throw std::string{ "maxthresh must be between 0 and 255 (inclusive)" };
+
+    if (d->mres < 0 || d->mres > 2)
+        throw std::string{ "mres must be 0, 1 or 2" };
+
+    if (d->athresh < -1 || d->athresh > 255)
+        throw std::string{ "athresh must be between -1 and 255 (inclusive)" };
+
+    if (d->metric < 0 || d->metric > 1)
+        throw std::string{ "metric must be 0 or 1" };
+
+    if (d->expand < 0)
+        throw std::string{ "expand must be greater than or equal to 0" };
+
+    if (d->type < 0 || d->type > 1)
+        throw std::string{ "type must be 0 or 1" };
+
+    if (d->opt < -1 || d->opt > 5)
+        throw std::string{ "opt must be -1, 0, 1, 2, 3, 4 or 5" };
+
+    if (d->bitsPerSample < 8 || d->bitsPerSample > 16)
+        throw std::string{ "only 8-16 bit integer input supported" };
+
+    if (d->height < 4)
+        throw std::string{ "height must be greater than or equal to 4" };
+
+    if (d->width & 1 || d->height & 1)
+        throw std::string{ "width and height must be multiples of 2" };
+
+    if (d->subSamplingW > 1)
+        throw std::string{ "only horizontal chroma subsampling 1x-2x supported" };
+
+    if (d->subSamplingH > 1)
+        throw std::string{ "only vertical chroma subsampling 1x-2x supported" };
+
+    if (d->link && d->gray)
+        throw std::string{ "link can not be true for Gray color family" };
+
+    if (d->lumaMask && d->gray)
+        throw std::string{ "lumamask can not be true for Gray color family" };
+
+    // calibration starts from the auto detected kernels, which are kept when there is nothing to time
+    selectFunctions(std::max(d->opt, 0), d);
+
+    d->peak = (1 << d->bitsPerSample) - 1;
+    d->motionAdaptive = d->mtqL > -2 || d->mthL > -2 || d->mtqC > -2 || d->mthC > -2;
+
+    // set up before the thresholds are scaled to the bit depth of the clip
+    if (((d->reduce && d->bitsPerSample > 8) || d->mres) && d->motionAdaptive) {
+        if (d->mres && d->width % 4)
+            throw std::string{ "width must be a multiple of 4 for mres" };
+
+        if (d->mres == 2 && d->height % (4 << d->subSamplingH))
+            throw std::string{ "height must be a multiple of " + std::to_string(4 << d->subSamplingH) + " for mres=2" };
+
+        auto analysis = std::make_shared<TDeintModCore>(*d);
+        if (d->reduce)
+            analysis->bitsPerSample = 8;
+        if (d->mres > 0)
+            analysis->width /= 2;
+        if (d->mres > 1)
+            analysis->height /= 2;
+        analysis->reduce = false;
+        analysis->mres = 0;
+        tdmInit(analysis.get());
+        d->analysis = std::move(analysis);
+    }
+
+    if (d->motionAdaptive) {
+        if (d->mtqL > -1)
+            d->mtqL = d->mtqL * d->peak / 255;
+        if (d->mthL > -1)
+            d->mthL = d->mthL * d->peak / 255;
+        if (d->mtqC > -1)
+            d->mtqC = d->mtqC * d->peak / 255;
+        if (d->mthC > -1)
+            d->mthC = d->mthC * d->peak / 255;
+        d->nt = d->nt * d->peak / 255;
+        d->minthresh = d->minthresh * d->peak / 255;
+        d->maxthresh = d->maxthresh * d->peak / 255;
+
+        for (int plane = 0; plane < d->numPlanes; plane++) {
+            d->hShift[plane] = plane ? d->subSamplingW : 0;
+            d->vShift[plane] = plane ? 1 << d->subSamplingH : 1;
+            d->hHalf[plane] = d->hShift[plane] ? 1 << (d->hShift[plane] - 1) : d->hShift[plane];
+            d->vHalf[plane] = 1 << (d->vShift[plane] - 1);
+            d->fixedThresh[plane] = plane ? (d->mtqC > -1 && d->mthC > -1) : (d->mtqL > -1 && d->mthL > -1);
+        }
+
+        if (d->mtype == 0) {
+            d->vlut = {
+                0, 1, 2, 2, 3, 0, 2, 2,
+                1, 1, 2, 2, 0, 1, 2, 2,
+                2, 2, 2, 2, 2, 2, 2, 2,
+                2, 2, 2, 2, 2, 2, 2, 2,
+                3, 0, 2, 2, 3, 3, 2, 2,
+                0, 1, 2, 2, 3, 1, 2, 2,
+                2, 2, 2, 2, 2, 2, 2, 2,
+                2, 2, 2, 2, 2, 2, 2, 2
+            };
+        } else if (d->mtype == 1) {
+            d->vlut = {
+                0, 0, 2, 2, 0, 0, 2, 2,
+                0, 1, 2, 2, 0, 1, 2, 2,
+                2, 2, 2, 2, 2, 2, 2, 2,
+                2, 2, 2, 2, 2, 2, 2, 2,
+                0, 0, 2, 2, 3, 3, 2, 2,
+                0, 1, 2, 2, 3, 1, 2, 2,
+                2, 2, 2, 2, 2, 2, 2, 2,
+                2, 2, 2, 2, 2, 2, 2, 2
+            };
+        } else {
+            d->vlut = {
+                0, 0, 0, 0, 0, 0, 0, 0,
+                0, 1, 0, 1, 0, 1, 0, 1,
+                0, 0, 2, 2, 0, 0, 2, 2,
+                0, 1, 2, 2, 0, 1, 2, 2,
+                0, 0, 0, 0, 3, 3, 3, 3,
+                0, 1, 0, 1, 3, 1, 3, 1,
+                0, 0, 2, 2, 3, 3, 2, 2,
+                0, 1, 2, 2, 3, 1, 2, 2
+            };
+        }
+
+        d->tmmlut16 = {
+            60, 20, 50, 10, 60, 10, 40, 30,
+            60, 10, 40, 30, 60, 20, 50, 10
+        };
+
+        if (d->opt == -1)
+            calibrate(d);
+    }
+
+    if (d->athresh > -1) {
+        d->athresh = d->athresh * d->peak / 255;
+        d->athresh6 = d->athresh * 6;
+        d->athreshsq = d->athresh * d->athresh;
+    }
+
+    d->dumbBob = !d->motionAdaptive && !d->show && d->athresh == -1;
+}
+
+void tdmCreateMotionMask(const TDeintModCore * d, const TDMFrame * src, const TDMFrame * thresh, const TDMFrame * motion, const TDMFrame & combined,
+                         const TDMFrame & dst, int64_t * times) {
+    int64_t start = stageClock(times);
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (tdmAnalyzed(d, plane)) {
+            if (!d->fixedThresh[plane]) {
+                for (int i = 0; i < 3; i++)
+                    d->threshMask(src[i], thresh[i], plane, d);
+            }
+            start = stageDone(times, stageThreshMask, start);
+            for (int i = 0; i < 2; i++)
+                d->motionMask(src[i], thresh ? thresh + i : nullptr, src[i + 1], thresh ? thresh + i + 1 : nullptr, motion[i], plane, d);
+            d->motionMask(src[0], thresh, src[2], thresh ? thresh + 2 : nullptr, combined, plane, d);
+            start = stageDone(times, stageMotionMask, start);
+            d->andMasks(motion[0], motion[1], combined, plane, d);
+            start = stageDone(times, stageAndMasks, start);
+            d->combineMasks(combined, dst, plane, d);
+            start = stageDone(times, stageCombineMasks, start);
+        }
+    }
+}
+
+template<typename T1, typename T2>
+static void reduceField(const TDeintModCore * d, const TDMFrame & src, const TDMFrame & dst) noexcept {
+    // mres=1 halves the width and mres=2 the height of the field too
+    const int xStep = (d->mres > 0) ? 1 : 0;
+    const int yStep = (d->mres > 1) ? 1 : 0;
+    const int scale = xStep + yStep;
+    const int half = (1 << scale) >> 1;
+    const int shift = d->bitsPerSample - d->analysis->bitsPerSample;
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (tdmAnalyzed(d, plane)) {
+            const int width = dst.width[plane];
+            const int height = dst.height[plane];
+            const int srcStride = src.stride[plane] / sizeof(T1);
+            const int dstStride = dst.stride[plane] / sizeof(T2);
+            const T1 * srcp = reinterpret_cast<const T1 *>(src.ptr[plane]);
+            T2 * TDM_RESTRICT dstp = reinterpret_cast<T2 *>(dst.ptr[plane]);
+
+            for (int y = 0; y < height; y++) {
+                const T1 * srcpn = srcp + srcStride * yStep;
+
+                for (int x = 0; x < width; x++) {
+                    const int xs = x << xStep;
+                    int sum = srcp[xs];
+                    if (xStep)
+                        sum += srcp[xs + 1];
+                    if (yStep)
+                        sum += srcpn[xs] + srcpn[xs + 1];
+                    dstp[x] = static_cast<T2>(((sum + half) >> scale) >> shift);
+                }
+
+                srcp += srcStride << yStep;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+void tdmReduceField(const TDeintModCore * d, const TDMFrame & src, const TDMFrame & dst) noexcept {
+    if (d->bitsPerSample <= 8)
+        reduceField<uint8_t, uint8_t>(d, src, dst);
+    else if (d->analysis->bitsPerSample <= 8)
+        reduceField<uint16_t, uint8_t>(d, src, dst);
+    else
+        reduceField<uint16_t, uint16_t>(d, src, dst);
+}
+
+template<typename T1, typename T2>
+static void upscaleMask(const TDeintModCore * d, const TDMFrame & reduced, const TDMFrame & dst) noexcept {
+    const int xStep = (d->mres > 0) ? 1 : 0;
+    const int yStep = (d->mres > 1) ? 1 : 0;
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = dst.width[plane];
+            const int height = dst.height[plane];
+            const int reducedWidth = reduced.width[plane];
+            const int reducedFieldHeight = reduced.height[plane] / 2;
+            const int reducedStride = reduced.stride[plane] / sizeof(T1);
+            const int dstStride = dst.stride[plane] / sizeof(T2);
+            const T1 * reducedp = reinterpret_cast<const T1 *>(reduced.ptr[plane]);
+            T2 * TDM_RESTRICT dstp = reinterpret_cast<T2 *>(dst.ptr[plane]);
+
+            for (int y = 0; y < height; y++) {
+                // line y / 2 of its field falls in line y / 2 >> yStep of the reduced field, and the odd lines of a pair are nearest
+                // to the next line of the reduced field
+                const int parity = y & 1;
+                const int line = y >> 1;
+                const int ry = line >> yStep;
+                const int ryn = !yStep ? ry : ((line & 1) ? std::min(ry + 1, reducedFieldHeight - 1) : std::max(ry - 1, 0));
+                const T1 * maskp = reducedp + reducedStride * (ry * 2 + parity);
+                const T1 * maskpn = reducedp + reducedStride * (ryn * 2 + parity);
+
+                for (int x = 0; x < width; x++) {
+                    const int rx = x >> xStep;
+                    const int rxn = !xStep ? rx : ((x & 1) ? std::min(rx + 1, reducedWidth - 1) : std::max(rx - 1, 0));
+                    const bool isMoving = maskp[rx] == 60 || maskp[rxn] == 60 || maskpn[rx] == 60 || maskpn[rxn] == 60;
+                    dstp[x] = isMoving ? 60 : maskp[rx];
+                }
+
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+void tdmBuildMask(const TDeintModCore * d, const TDMFrame * cSrc, const TDMFrame * oSrc, const int cCount, const int oCount, const int order, const int field,
+                  const TDMFrame & dst, const TDMFrame * reduced, int * summary, double * movingRatio) noexcept {
+    const TDeintModCore * a = d->analysis ? d->analysis.get() : d;
+    const TDMFrame & mask = d->analysis ? *reduced : dst;
+
+    a->buildMask(cSrc, oSrc, mask, cCount, oCount, order, field, summary, movingRatio, a);
+    if (d->lumaMask)
+        a->chromaFromLuma(mask, field, movingRatio, a);
+
+    if (d->analysis) {
+        if (d->bitsPerSample <= 8)
+            upscaleMask<uint8_t, uint8_t>(d, mask, dst);
+        else if (a->bitsPerSample <= 8)
+            upscaleMask<uint8_t, uint16_t>(d, mask, dst);
+        else
+            upscaleMask<uint16_t, uint16_t>(d, mask, dst);
+    }
+}
+
+int tdmLastMotionFrame(const int n, const int numFrames, const TDeintModCore * d) noexcept {
+    const int last = numFrames - 3;
+    return (d->lookahead > -1) ? std::min(n + d->lookahead - 2, last) : last;
+}
+
+void tdmMaskWindow(const int n, const int order, const int field, const TDeintModCore * d, int * tStart, int * tStop, int * bStart, int * bStop) noexcept {
+    if (field == 1) {
+        *tStart = n - (d->length - 1) / 2;
+        *tStop = n + (d->length - 1) / 2 - 2;
+        const int bn = (order == 1) ? n - 1 : n;
+        *bStart = bn - (d->length - 2) / 2;
+        *bStop = bn + 1 + (d->length - 2) / 2 - 2;
+    } else {
+        const int tn = (order == 0) ? n - 1 : n;
+        *tStart = tn - (d->length - 2) / 2;
+        *tStop = tn + 1 + (d->length - 2) / 2 - 2;
+        *bStart = n - (d->length - 1) / 2;
+        *bStop = n + (d->length - 1) / 2 - 2;
+    }
+}
+
+void tdmRefineMask(const TDeintModCore * d, const TDMFrame & src, const TDMFrame * mask, const int field, double * interpolatedRatio) {
+    if (mask) {
+        if (d->athresh > -1)
+            d->checkSpatial(src, *mask, d);
+
+        if (d->expand)
+            d->expandMask(*mask, field, d);
+
+        if (d->link)
+            d->linkMask(*mask, field, d);
+
+        d->countInterpolated(*mask, field, interpolatedRatio, d);
+    } else {
+        // the outermost line of the interpolated field is kept when bobbing without a mask
+        for (int plane = 0; plane < d->numPlanes; plane++) {
+            if (d->process[plane]) {
+                const int height = d->height >> (plane ? d->subSamplingH : 0);
+                const int lines = (height + 1 - field) / 2;
+                interpolatedRatio[plane] = (field == 0 || !(height & 1)) ? static_cast<double>(lines - 1) / lines : 1.;
+            }
+        }
+    }
+}
+
+void tdmComposeFrame(const TDeintModCore * d, const TDMFrame & dst, const TDMFrame * mask, const TDMFrame * prv, const TDMFrame & src, const TDMFrame * nxt,
+                     const TDMFrame * edeint, const int field, const int summary) {
+    if (d->show) {
+        d->binaryMask(*mask, dst, d);
+    } else if (summary == maskAllStatic) {
+        const int bytesPerSample = (d->bitsPerSample + 7) / 8;
+        for (int plane = 0; plane < d->numPlanes; plane++) {
+            if (d->process[plane])
+                tdmBitblt(dst.ptr[plane], dst.stride[plane], src.ptr[plane], src.stride[plane], src.width[plane] * bytesPerSample, src.height[plane]);
+        }
+    } else if (summary == maskAllMoving) {
+        d->bobDeint(dst, src, edeint, field, !mask, d);
+    } else if (edeint) {
+        d->eDeint(dst, *mask, *prv, src, *nxt, *edeint, d);
+    } else if (d->type == 1) {
+        d->elaDeint(dst, *mask, *prv, src, *nxt, d);
+    } else {
+        d->cubicDeint(dst, *mask, *prv, src, *nxt, d);
+    }
+}
+
+//////////////////////////////////////////
+// IsCombed
+
+static bool isPowerOf2(const int i) noexcept {
+    return i && !(i & (i - 1));
+}
+
+void tdmSetDefaults(IsCombedCore * d) noexcept {
+    d->cthresh = 6;
+    d->blockx = 16;
+    d->blocky = 16;
+    d->chroma = false;
+    d->MI = 64;
+    d->metric = 0;
+}
+
+void tdmInit(IsCombedCore * d, const int bitsPerSample, const bool gray) {
+    if (d->height < 5)
+        throw std::string{ "height must be greater than or equal to 5" };
+
+    if (d->subSamplingW > 2)
+        throw std::string{ "only horizontal chroma subsampling 1x-4x supported" };
+
+    if (d->subSamplingH > 2)
+        throw std::string{ "only vertical chroma subsampling 1x-4x supported" };
+
+    if (d->cthresh < 0 || d->cthresh > 255)
+        throw std::string{ "cthresh must be between 0 and 255 (inclusive)" };
+
+    if (!isPowerOf2(d->blockx) || d->blockx < 4 || d->blockx > 2048)
+        throw std::string{ "illegal blockx size" };
+
+    if (!isPowerOf2(d->blocky) || d->blocky < 4 || d->blocky > 2048)
+        throw std::string{ "illegal blocky size" };
+
+    if (d->chroma && gray)
+        throw std::string{ "chroma can not be true for Gray color family" };
+
+    if (d->MI < 0)
+        throw std::string{ "mi must be greater than or equal to 0" };
+
+    if (d->metric < 0 || d->metric > 1)
+        throw std::string{ "metric must be 0 or 1" };
+
+    selectGenericKernels(d, bitsPerSample);
+#ifdef VS_TARGET_CPU_X86
+    const int iset = instrset_detect();
+    if (iset >= 10)
+        selectGenericKernels_avx512(d, bitsPerSample);
+    else if (iset >= 8)
+        selectGenericKernels_avx2(d, bitsPerSample);
+#endif
+
+    d->cthresh = d->cthresh * ((1 << bitsPerSample) - 1) / 255;
+    d->cthresh6 = d->cthresh * 6;
+    d->cthreshsq = d->cthresh * d->cthresh;
+
+    d->xHalf = d->blockx / 2;
+    d->yHalf = d->blocky / 2;
+    d->xShift = static_cast<int>(std::log2(d->blockx));
+    d->yShift = static_cast<int>(std::log2(d->blocky));
+
+    const int xBlocks = ((d->width + d->xHalf) >> d->xShift) + 1;
+    const int yBlocks = ((d->height + d->yHalf) >> d->yShift) + 1;
+    d->arraySize = xBlocks * yBlocks * 4;
+    d->xBlocks4 = xBlocks * 4;
+
+    d->widtha = (d->width >> (d->xShift - 1)) << (d->xShift - 1);
+    d->heighta = (d->height >> (d->yShift - 1)) << (d->yShift - 1);
+    if (d->heighta == d->height)
+        d->heighta = d->height - d->yHalf;
+}
+
+//////////////////////////////////////////
+// Frame window
+
+TDMBuffer::TDMBuffer(const int width, const int height, const int numPlanes, const int bytesPerSample, const int subSamplingW, const int subSamplingH) : f{} {
+    constexpr size_t alignment = 64;
+
+    size_t offsets[3], size = 0;
+    for (int plane = 0; plane < numPlanes; plane++) {
+        f.width[plane] = width >> (plane ? subSamplingW : 0);
+        f.height[plane] = height >> (plane ? subSamplingH : 0);
+        f.stride[plane] = (f.width[plane] * bytesPerSample + alignment - 1) & ~(alignment - 1);
+        offsets[plane] = size;
+        size += static_cast<size_t>(f.stride[plane]) * f.height[plane];
+    }
+
+    data.reset(new uint8_t[size + alignment - 1]());
+    uint8_t * base = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(data.get()) + alignment - 1) & ~(alignment - 1));
+    for (int plane = 0; plane < numPlanes; plane++)
+        f.ptr[plane] = base + offsets[plane];
+}
+
+TDeintModProcessor::TDeintModProcessor(const TDeintModCore & core, const int frames, FrameSource source, FrameSource edeint) :
+    d(core), numFrames(frames), bytesPerSample((core.bitsPerSample + 7) / 8), sourceFunc(std::move(source)), edeintFunc(std::move(edeint)) {
+    if (numFrames < 1)
+        throw std::string{ "the clip must have at least one frame" };
+
+    if (d.motionAdaptive && d.height % (2 << d.subSamplingH))
+        throw std::string{ "height must be a multiple of " + std::to_string(2 << d.subSamplingH) + " for motion adaptation" };
+
+    if (d.lumaMask && !d.process[0])
+        throw std::string{ "lumamask requires the luma plane to be processed" };
+
+    if (d.motionAdaptive) {
+        const TDeintModCore & a = d.analysis ? *d.analysis : d;
+        zero.reset(new TDMBuffer{ a.width, a.height / 2, d.numPlanes, (a.bitsPerSample + 7) / 8, d.subSamplingW, d.subSamplingH });
+    }
+}
+
+int TDeintModProcessor::interpolatedField(const int n) const noexcept {
+    if (d.mode == 1)
+        return (n & 1) ? 1 - d.order : d.order;
+    return (d.field == -1) ? d.order : d.field;
+}
+
+int TDeintModProcessor::lastSourceFrame(const int n) const noexcept {
+    const int nSrc = (d.mode == 1) ? n / 2 : n;
+    int last = std::min(nSrc + 1, numFrames - 1);
+
+    if (d.motionAdaptive) {
+        int tStart, tStop, bStart, bStop;
+        tdmMaskWindow(nSrc, d.order, interpolatedField(n), &d, &tStart, &tStop, &bStart, &bStop);
+        const int lastMask = std::min(std::max(tStop, bStop), tdmLastMotionFrame(nSrc, numFrames, &d));
+        last = std::max(last, std::min(lastMask + 2, numFrames - 1));
+    }
+
+    return last;
+}
+
+void TDeintModProcessor::setNumFrames(const int frames) {
+    if (frames < 1)
+        throw std::string{ "the clip must have at least one frame" };
+
+    numFrames = frames;
+}
+
+void TDeintModProcessor::copyFrame(const TDMFrame & dst, const TDMFrame & src, const bool unprocessedOnly) const noexcept {
+    for (int plane = 0; plane < d.numPlanes; plane++) {
+        if (!unprocessedOnly || !d.process[plane])
+            tdmBitblt(dst.ptr[plane], dst.stride[plane], src.ptr[plane], src.stride[plane], src.width[plane] * bytesPerSample, src.height[plane]);
+    }
+}
+
+// Returns entry n of a cache. The first call for an entry computes it outside the lock, and calls for the same entry meanwhile wait
+// for its result.
+template<typename T, typename F>
+std::shared_ptr<T> TDeintModProcessor::cached(Cache<T> & cache, const int n, F compute) {
+    std::unique_lock<std::mutex> lock{ mutex };
+    auto iter = cache.find(n);
+    if (iter != cache.end()) {
+        const std::shared_future<std::shared_ptr<T>> result = iter->second;
+        lock.unlock();
+        return result.get();
+    }
+
+    std::promise<std::shared_ptr<T>> promise;
+    cache.emplace(n, promise.get_future().share());
+    lock.unlock();
+
+    try {
+        std::shared_ptr<T> result = compute();
+        promise.set_value(result);
+        return result;
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+std::unique_ptr<TDeintModProcessor::Scratch> TDeintModProcessor::acquireScratch() {
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        if (!spare.empty()) {
+            std::unique_ptr<Scratch> scratch = std::move(spare.back());
+            spare.pop_back();
+            return scratch;
+        }
+    }
+
+    std::unique_ptr<Scratch> scratch{ new Scratch };
+    if (d.motionAdaptive) {
+        // the motion masks have the layout of the analysis
+        const TDeintModCore & a = d.analysis ? *d.analysis : d;
+        const int maskBytes = (a.bitsPerSample + 7) / 8;
+        const int fieldHeight = a.height / 2;
+
+        bool adaptive = false;
+        for (int plane = 0; plane < d.numPlanes; plane++)
+            adaptive |= tdmAnalyzed(&d, plane) && !d.fixedThresh[plane];
+
+        for (int i = 0; i < 3; i++) {
+            if (adaptive)
+                scratch->thresh[i].reset(new TDMBuffer{ a.width, fieldHeight * 2, 1, maskBytes, 0, 0 });
+            if (d.analysis)
+                scratch->reduced[i].reset(new TDMBuffer{ a.width, fieldHeight, d.numPlanes, maskBytes, d.subSamplingW, d.subSamplingH });
+        }
+        for (int i = 0; i < 2; i++)
+            scratch->motion[i].reset(new TDMBuffer{ a.width, fieldHeight * 2, 1, maskBytes, 0, 0 });
+        scratch->combined.reset(new TDMBuffer{ a.width, fieldHeight * 2, 1, maskBytes, 0, 0 });
+        if (d.analysis)
+            scratch->reducedMask.reset(new TDMBuffer{ a.width, a.height, d.numPlanes, maskBytes, d.subSamplingW, d.subSamplingH });
+    }
+
+    if (!d.dumbBob)
+        scratch->mask.reset(new TDMBuffer{ d.width, d.height, d.numPlanes, bytesPerSample, d.subSamplingW, d.subSamplingH });
+    return scratch;
+}
+
+std::shared_ptr<const TDMFrame> TDeintModProcessor::source(const int n) {
+    return cached(sources, n, [&] {
+        // the motion masks are built straight from the fields unless they are reduced first
+        std::shared_ptr<const TDMFrame> frame = sourceFunc(n);
+        if (d.motionAdaptive && !d.analysis && !tdmIsAligned(*frame, d.numPlanes)) {
+            auto buffer = std::make_shared<TDMBuffer>(d.width, d.height, d.numPlanes, bytesPerSample, d.subSamplingW, d.subSamplingH);
+            copyFrame(buffer->frame(), *frame, false);
+            frame = std::shared_ptr<const TDMFrame>{ buffer, &buffer->frame() };
+        }
+        return frame;
+    });
+}
+
+std::shared_ptr<TDMBuffer> TDeintModProcessor::motionMask(const int parity, const int n, const Scratch & scratch) {
+    return cached(motionMasks[parity], n, [&] {
+        std::shared_ptr<const TDMFrame> frames[3];
+        TDMFrame src[3];
+        for (int i = 0; i < 3; i++) {
+            frames[i] = source(std::min(n + i, numFrames - 1));
+            src[i] = fieldOf(*frames[i], parity, d.numPlanes);
+            if (d.analysis) {
+                tdmReduceField(&d, src[i], scratch.reduced[i]->frame());
+                src[i] = scratch.reduced[i]->frame();
+            }
+        }
+
+        TDMFrame threshFrames[3], motionFrames[2];
+        for (int i = 0; i < 3; i++) {
+            if (scratch.thresh[i])
+                threshFrames[i] = scratch.thresh[i]->frame();
+        }
+        for (int i = 0; i < 2; i++)
+            motionFrames[i] = scratch.motion[i]->frame();
+
+        const TDeintModCore & a = d.analysis ? *d.analysis : d;
+        auto buffer = std::make_shared<TDMBuffer>(a.width, a.height / 2, d.numPlanes, (a.bitsPerSample + 7) / 8, d.subSamplingW, d.subSamplingH);
+        tdmCreateMotionMask(&a, src, scratch.thresh[0] ? threshFrames : nullptr, motionFrames, scratch.combined->frame(), buffer->frame(), nullptr);
+        return buffer;
+    });
+}
+
+int TDeintModProcessor::release(const int n) {
+    // the motion masks the frames from n on need reach at least two frames before the last frame done, and the ones that are not
+    // cached yet only start after them
+    const int nSrc = (d.mode == 1) ? (n - 1) / 2 : n - 1;
+    std::lock_guard<std::mutex> lock{ mutex };
+
+    for (auto iter = sources.begin(); iter != sources.end();) {
+        if (iter->first < nSrc - 1)
+            iter = sources.erase(iter);
+        else
+            ++iter;
+    }
+
+    for (int parity = 0; parity < 2; parity++) {
+        for (auto iter = motionMasks[parity].begin(); iter != motionMasks[parity].end();) {
+            if (iter->first < nSrc - d.length)
+                iter = motionMasks[parity].erase(iter);
+            else
+                ++iter;
+        }
+    }
+
+    return std::max(nSrc - 1, 0);
+}
+
+void TDeintModProcessor::getFrame(const int n, const TDMFrame & dst, int * summary, double * movingRatio, double * interpolatedRatio) {
+    const int nSrc = (d.mode == 1) ? n / 2 : n;
+    const int field = interpolatedField(n);
+
+    std::unique_ptr<Scratch> scratch = acquireScratch();
+    const TDMFrame * mask = scratch->mask ? &scratch->mask->frame() : nullptr;
+
+    const std::shared_ptr<const TDMFrame> srcFrame = source(nSrc);
+    const TDMFrame & src = *srcFrame;
+
+    double moving[3] = {}, interpolated[3] = {};
+    for (int plane = 0; plane < d.numPlanes; plane++) {
+        if (d.process[plane])
+            moving[plane] = interpolated[plane] = 1.;
+    }
+
+    int sum = maskMixed;
+    if (d.motionAdaptive) {
+        int tStart, tStop, bStart, bStop;
+        tdmMaskWindow(nSrc, d.order, field, &d, &tStart, &tStop, &bStart, &bStop);
+        const int last = tdmLastMotionFrame(nSrc, numFrames, &d);
+
+        // the masks are held until the frame is built, as release may drop them from the cache meanwhile
+        std::vector<std::shared_ptr<TDMBuffer>> masks;
+        std::vector<TDMFrame> top, bottom;
+        for (int i = tStart; i <= tStop; i++) {
+            if (i >= 0 && i <= last)
+                masks.push_back(motionMask(0, i, *scratch));
+            top.push_back((i < 0 || i > last) ? zero->frame() : masks.back()->frame());
+        }
+        for (int i = bStart; i <= bStop; i++) {
+            if (i >= 0 && i <= last)
+                masks.push_back(motionMask(1, i, *scratch));
+            bottom.push_back((i < 0 || i > last) ? zero->frame() : masks.back()->frame());
+        }
+
+        const std::vector<TDMFrame> & cSrc = (field == 1) ? bottom : top;
+        const std::vector<TDMFrame> & oSrc = (field == 1) ? top : bottom;
+        tdmBuildMask(&d, cSrc.data(), oSrc.data(), static_cast<int>(cSrc.size()), static_cast<int>(oSrc.size()), d.order, field, *mask,
+                     scratch->reducedMask ? &scratch->reducedMask->frame() : nullptr, &sum, moving);
+        std::copy_n(moving, 3, interpolated);
+        if (sum == maskAllMoving && d.athresh > -1)
+            sum = maskMixed;
+    } else if (d.dumbBob) {
+        sum = maskAllMoving;
+    } else {
+        d.setMaskForUpsize(*mask, field, &d);
+    }
+
+    if (d.show || sum == maskMixed)
+        tdmRefineMask(&d, src, mask, field, interpolated);
+    else if (d.dumbBob)
+        tdmRefineMask(&d, src, nullptr, field, interpolated);
+
+    if (!d.show && sum == maskAllStatic) {
+        copyFrame(dst, src, false);
+    } else {
+        std::shared_ptr<const TDMFrame> prv, nxt, edeint;
+        if (!d.show && sum == maskMixed) {
+            prv = source(std::max(nSrc - 1, 0));
+            nxt = source(std::min(nSrc + 1, numFrames - 1));
+        }
+
+        if (!d.show && edeintFunc)
+            edeint = edeintFunc(n);
+
+        // the kernels write every pixel of the processed planes, so only the others are taken over from the source
+        copyFrame(dst, src, true);
+        tdmComposeFrame(&d, dst, mask, prv.get(), src, nxt.get(), edeint.get(), field, sum);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        spare.push_back(std::move(scratch));
+    }
+
+    if (summary)
+        *summary = sum;
+    if (movingRatio)
+        std::copy_n(moving, d.numPlanes, movingRatio);
+    if (interpolatedRatio)
+        std::copy_n(interpolated, d.numPlanes, interpolatedRatio);
+}
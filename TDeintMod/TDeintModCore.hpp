@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef VS_TARGET_CPU_X86
+#include "vectorclass/vectorclass.h"
+#endif
+
+// The portable SIMD kernels (opt=4) are written with the GCC/Clang vector extensions
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9)
+#define TDM_VECTOR_EXTENSIONS
+#endif
+
+#ifdef _MSC_VER
+#define TDM_RESTRICT __restrict
+#else
+#define TDM_RESTRICT __restrict__
+#endif
+
+// A view of the planes of a frame. Strides are in bytes, and every kernel steps through each frame with its own strides.
+//
+// The SSE2 and AVX2 kernels behind tdmCreateMotionMask use aligned loads and stores that run on to the next multiple of
+// tdmFrameAlignment bytes past the width of a line. The frames passed to it must therefore start each plane on a
+// tdmFrameAlignment boundary and have strides that are multiples of it, as frames from VapourSynth and TDMBuffer do. The kernels
+// that refine masks and compose frames have no such requirement.
+struct TDMFrame {
+    uint8_t * ptr[3];
+    int stride[3], width[3], height[3];
+};
+
+constexpr int tdmFrameAlignment = 32;
+
+enum MaskSummary {
+    maskMixed,
+    maskAllStatic,
+    maskAllMoving
+};
+
+enum TimedStage {
+    stageThreshMask,
+    stageMotionMask,
+    stageAndMasks,
+    stageCombineMasks,
+    stageBuildMask,
+    stageSpatial,
+    stageDeint,
+    stageCount
+};
+
+struct TDeintModCore {
+    int width, height, numPlanes, bitsPerSample, subSamplingW, subSamplingH;
+    bool gray;
+    int order, field, mode, length, lookahead, mtype, ttype, mtqL, mthL, mtqC, mthC, nt, minthresh, maxthresh, cstr, mres, athresh, metric, expand, type, opt;
+    bool link, show, lumaMask, reduce, process[3], fixedThresh[3], motionAdaptive, dumbBob;
+    int hShift[3], vShift[3], hHalf[3], vHalf[3], athresh6, athreshsq, peak, selectedOpt;
+    std::array<uint8_t, 64> vlut;
+    std::array<uint8_t, 16> tmmlut16;
+    // The setup the motion masks are built with when reduce is set for a high bit depth clip or mres isn't 0, null otherwise. It has the
+    // reduced bit depth and dimensions, and each field is converted to it before the analysis.
+    std::shared_ptr<const TDeintModCore> analysis;
+    void (*threshMask)(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *);
+    void (*motionMask)(const TDMFrame &, const TDMFrame *, const TDMFrame &, const TDMFrame *, const TDMFrame &, const int, const TDeintModCore *);
+    void (*andMasks)(const TDMFrame &, const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *);
+    void (*combineMasks)(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *);
+    void (*buildMask)(const TDMFrame *, const TDMFrame *, const TDMFrame &, const int, const int, const int, const int, int *, double *, const TDeintModCore *);
+    void (*chromaFromLuma)(const TDMFrame &, const int, double *, const TDeintModCore *);
+    void (*setMaskForUpsize)(const TDMFrame &, const int, const TDeintModCore *);
+    void (*countInterpolated)(const TDMFrame &, const int, double *, const TDeintModCore *);
+    void (*checkSpatial)(const TDMFrame &, const TDMFrame &, const TDeintModCore *);
+    void (*expandMask)(const TDMFrame &, const int, const TDeintModCore *);
+    void (*linkMask)(const TDMFrame &, const int, const TDeintModCore *);
+    void (*eDeint)(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *);
+    void (*cubicDeint)(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *);
+    void (*elaDeint)(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *);
+    void (*bobDeint)(const TDMFrame &, const TDMFrame &, const TDMFrame *, const int, const bool, const TDeintModCore *);
+    void (*binaryMask)(const TDMFrame &, const TDMFrame &, const TDeintModCore *);
+};
+
+struct IsCombedCore {
+    int width, height, subSamplingW, subSamplingH;
+    int cthresh, blockx, blocky, MI, metric;
+    bool chroma;
+    int cthresh6, cthreshsq, xHalf, yHalf, xShift, yShift, arraySize, xBlocks4, widtha, heighta;
+    bool (*checkCombed)(const TDMFrame &, const TDMFrame &, int *, const IsCombedCore *);
+};
+
+// Whether the motion masks of a plane are built from its own pixels. With lumaMask the chroma masks are derived from the luma mask instead.
+inline bool tdmAnalyzed(const TDeintModCore * d, const int plane) noexcept {
+    return d->process[plane] && !(plane && d->lumaMask);
+}
+
+// Fills in the defaults of every TDeintMod parameter
+void tdmSetDefaults(TDeintModCore * d) noexcept;
+
+// Validates the parameters and the frame format, then derives the lookup tables and thresholds and picks the kernels. Throws std::string on error.
+void tdmInit(TDeintModCore * d);
+
+// Validates the widths of the borders left out of the processing, in the order of std.Crop: left, right, top, bottom, and narrows the
+// dimensions of d to the picture inside them. Called before tdmInit. Throws std::string on error.
+void tdmSetCrop(TDeintModCore * d, const int * crop);
+
+// Narrows a view of a frame of the uncropped clip to the picture inside the borders given to tdmSetCrop
+TDMFrame tdmCropView(const TDeintModCore * d, TDMFrame frame, const int * crop) noexcept;
+
+// Motion mask of a field against the next two fields of the same parity. thresh is only needed for planes without fixed thresholds.
+// Every frame must be aligned as described at TDMFrame.
+void tdmCreateMotionMask(const TDeintModCore * d, const TDMFrame * src, const TDMFrame * thresh, const TDMFrame * motion, const TDMFrame & combined,
+                         const TDMFrame & dst, int64_t * times);
+
+// Converts the analyzed planes of a field to the bit depth and dimensions of d->analysis, averaging the pixels a reduced pixel covers.
+// Only used when d->analysis is set.
+void tdmReduceField(const TDeintModCore * d, const TDMFrame & src, const TDMFrame & dst) noexcept;
+
+// Builds the mask of a frame from the motion masks of both parities and derives the chroma masks with lumaMask. With d->analysis the
+// motion masks have its layout and the mask is built in reduced, a frame of that layout, before being scaled up into dst. A pixel is
+// moving if the reduced pixel it falls in or the nearest neighbor of that pixel in each direction is moving.
+void tdmBuildMask(const TDeintModCore * d, const TDMFrame * cSrc, const TDMFrame * oSrc, const int cCount, const int oCount, const int order, const int field,
+                  const TDMFrame & dst, const TDMFrame * reduced, int * summary, double * movingRatio) noexcept;
+
+// Index of the last motion mask frame the mask for frame n may use
+int tdmLastMotionFrame(const int n, const int numFrames, const TDeintModCore * d) noexcept;
+
+// Ranges of the motion mask frames of each parity that the mask for frame n is built from
+void tdmMaskWindow(const int n, const int order, const int field, const TDeintModCore * d, int * tStart, int * tStop, int * bStart, int * bStop) noexcept;
+
+// Applies spatial adaptation, expansion and linking to a mask and measures the interpolated ratio. Without a mask the ratio of dumb bobbing is measured.
+void tdmRefineMask(const TDeintModCore * d, const TDMFrame & src, const TDMFrame * mask, const int field, double * interpolatedRatio);
+
+// Produces the processed planes of dst, which must have the dimensions of src like every other frame. mask may only be null for dumb
+// bobbing, prv and nxt when summary isn't maskMixed and edeint to interpolate with the internal method given by type instead.
+void tdmComposeFrame(const TDeintModCore * d, const TDMFrame & dst, const TDMFrame * mask, const TDMFrame * prv, const TDMFrame & src, const TDMFrame * nxt,
+                     const TDMFrame * edeint, const int field, const int summary);
+
+void tdmBitblt(void * dstp, const int dstStride, const void * srcp, const int srcStride, const size_t rowSize, const size_t height) noexcept;
+
+// Whether the planes of a frame are aligned as tdmCreateMotionMask requires
+bool tdmIsAligned(const TDMFrame & frame, const int numPlanes) noexcept;
+
+void tdmSetDefaults(IsCombedCore * d) noexcept;
+
+// Throws std::string on error
+void tdmInit(IsCombedCore * d, const int bitsPerSample, const bool gray);
+
+// A frame with planes in memory owned by the library, aligned for the SIMD kernels
+class TDMBuffer {
+public:
+    TDMBuffer(const int width, const int height, const int numPlanes, const int bytesPerSample, const int subSamplingW, const int subSamplingH);
+    const TDMFrame & frame() const noexcept { return f; }
+
+private:
+    std::unique_ptr<uint8_t[]> data;
+    TDMFrame f;
+};
+
+// Runs TDeintMod over a clip without VapourSynth. Source frames are requested through a callback and kept in a window that
+// also caches the motion masks of both field parities. getFrame may be called from several threads at once: every source frame
+// and motion mask is obtained once, by the first call that needs it, while the other calls wait for it. The window only shrinks
+// through release.
+class TDeintModProcessor {
+public:
+    // Returns a view of frame n of a clip, which has to stay valid while the pointer is held. Frames are used in place, except
+    // that those tdmCreateMotionMask would read but that aren't aligned as described at TDMFrame are copied into an aligned buffer.
+    using FrameSource = std::function<std::shared_ptr<const TDMFrame>(int n)>;
+
+    // core must have been set up by tdmInit. frames is the number of frames of the source, edeint is indexed by output frame number.
+    // Throws std::string on error.
+    TDeintModProcessor(const TDeintModCore & core, const int frames, FrameSource source, FrameSource edeint = nullptr);
+
+    int numOutputFrames() const noexcept { return (d.mode == 1) ? numFrames.load() * 2 : numFrames.load(); }
+
+    // Index of the last source frame getFrame(n) may request, for callers that read their source sequentially
+    int lastSourceFrame(const int n) const noexcept;
+
+    // Updates the number of source frames, for sources whose length is only known once their end is reached. Frames that were
+    // already requested must stay valid under the new length.
+    void setNumFrames(const int frames);
+
+    // Writes output frame n into dst. The mask summary and the per-plane ratios are returned through the optional arguments.
+    void getFrame(const int n, const TDMFrame & dst, int * summary = nullptr, double * movingRatio = nullptr, double * interpolatedRatio = nullptr);
+
+    // Output frames before n won't be requested any more, so the source frames and motion masks only they need are dropped.
+    // Callers with several getFrame calls in flight pass the lowest of their frame numbers. Returns the first source frame that
+    // getFrame may still request, for callers that read their source sequentially.
+    int release(const int n);
+
+private:
+    // The buffers a getFrame call works in
+    struct Scratch {
+        std::unique_ptr<TDMBuffer> thresh[3], motion[2], combined, reduced[3], reducedMask, mask;
+    };
+
+    template<typename T>
+    using Cache = std::unordered_map<int, std::shared_future<std::shared_ptr<T>>>;
+
+    int interpolatedField(const int n) const noexcept;
+    void copyFrame(const TDMFrame & dst, const TDMFrame & src, const bool unprocessedOnly) const noexcept;
+    template<typename T, typename F>
+    std::shared_ptr<T> cached(Cache<T> & cache, const int n, F compute);
+    std::unique_ptr<Scratch> acquireScratch();
+    std::shared_ptr<const TDMFrame> source(const int n);
+    std::shared_ptr<TDMBuffer> motionMask(const int parity, const int n, const Scratch & scratch);
+
+    const TDeintModCore d;
+    std::atomic<int> numFrames;
+    const int bytesPerSample;
+    const FrameSource sourceFunc, edeintFunc;
+    std::mutex mutex;
+    Cache<const TDMFrame> sources;
+    Cache<TDMBuffer> motionMasks[2];
+    std::vector<std::unique_ptr<Scratch>> spare;
+    std::unique_ptr<TDMBuffer> zero;
+};
@@ -0,0 +1,1119 @@
+#pragma once
+
+// The kernels that have no hand-written SIMD. They are plain C++ with internal linkage, so every translation unit that includes this
+// header gets its own copy compiled for that unit's instruction set, and the auto-vectorizer can use the wider registers.
+
+#include <cmath>
+#include <cstring>
+
+#include "TDeintModCore.hpp"
+
+// fixedLength is the length the kernel is specialised for, with the scans of the static periods unrolled, or 0 for any length
+template<typename T, int fixedLength>
+static void buildMaskKernel(const TDMFrame * cSrc, const TDMFrame * oSrc, const TDMFrame & dst, const int cCount, const int oCount, const int order, const int field,
+                            int * summary, double * movingRatio, const TDeintModCore * d) noexcept {
+    const int length = fixedLength ? fixedLength : d->length;
+
+    const uint8_t * tmmlut = d->tmmlut16.data() + order * 8 + field * 4;
+    uint8_t tmmlutf[64];
+    for (int i = 0; i < 64; i++)
+        tmmlutf[i] = tmmlut[d->vlut[i]];
+
+    T plutFixed[2][fixedLength ? 2 * fixedLength - 1 : 1];
+    T * TDM_RESTRICT plut[2];
+    for (int i = 0; i < 2; i++)
+        plut[i] = fixedLength ? plutFixed[i] : new T[2 * length - 1];
+
+    const T ** ptlut[3];
+    for (int i = 0; i < 3; i++)
+        ptlut[i] = new const T *[i & 1 ? cCount : oCount];
+
+    const int offo = (length & 1) ? 0 : 1;
+    const int offc = (length & 1) ? 1 : 0;
+    const int ct = cCount / 2;
+
+    bool allStatic = true, allMoving = true;
+    std::fill_n(movingRatio, 3, 0.);
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (tdmAnalyzed(d, plane)) {
+            int64_t moving = 0;
+
+            const int width = dst.width[plane];
+            const int height = dst.height[plane];
+            const int stride = dst.stride[plane] / sizeof(T);
+            const int srcStride = cSrc[0].stride[plane] / sizeof(T);
+            for (int i = 0; i < cCount; i++)
+                ptlut[1][i] = reinterpret_cast<const T *>(cSrc[i].ptr[plane]);
+            for (int i = 0; i < oCount; i++) {
+                if (field == 1) {
+                    ptlut[0][i] = reinterpret_cast<const T *>(oSrc[i].ptr[plane]);
+                    ptlut[2][i] = ptlut[0][i] + srcStride;
+                } else {
+                    ptlut[0][i] = ptlut[2][i] = reinterpret_cast<const T *>(oSrc[i].ptr[plane]);
+                }
+            }
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            if (field == 1) {
+                for (int j = 0; j < height; j += 2)
+                    std::fill_n(dstp + stride * j, width, static_cast<T>(10));
+                dstp += stride;
+            } else {
+                for (int j = 1; j < height; j += 2)
+                    std::fill_n(dstp + stride * j, width, static_cast<T>(10));
+            }
+
+            for (int y = field; y < height; y += 2) {
+                for (int x = 0; x < width; x++) {
+                    if (!ptlut[1][ct - 2][x] && !ptlut[1][ct][x] && !ptlut[1][ct + 1][x]) {
+                        dstp[x] = 60;
+                        allStatic = false;
+                        moving++;
+                        continue;
+                    }
+
+                    for (int j = 0; j < cCount; j++)
+                        plut[0][j * 2 + offc] = plut[1][j * 2 + offc] = ptlut[1][j][x];
+                    for (int j = 0; j < oCount; j++) {
+                        plut[0][j * 2 + offo] = ptlut[0][j][x];
+                        plut[1][j * 2 + offo] = ptlut[2][j][x];
+                    }
+
+                    int val = 0;
+                    for (int i = 0; i < length; i++) {
+                        const int gv = (i == 0) ? 1 : (i == length - 1 ? 4 : 2);
+                        for (int j = 0; j < length - 4; j++) {
+                            if (!plut[0][i + j])
+                                goto j1;
+                        }
+                        val |= gv * 8;
+                    j1:
+                        for (int j = 0; j < length - 4; j++) {
+                            if (!plut[1][i + j])
+                                goto j2;
+                        }
+                        val |= gv;
+                    j2:
+                        if (d->vlut[val] == 2)
+                            break;
+                    }
+                    dstp[x] = tmmlutf[val];
+                    allStatic &= (dstp[x] == 10);
+                    allMoving &= (dstp[x] == 60);
+                    moving += (dstp[x] == 60);
+                }
+
+                for (int i = 0; i < cCount; i++)
+                    ptlut[1][i] += srcStride;
+                for (int i = 0; i < oCount; i++) {
+                    if (y != 0)
+                        ptlut[0][i] += srcStride;
+                    if (y != height - 3)
+                        ptlut[2][i] += srcStride;
+                }
+                dstp += stride * 2;
+            }
+
+            movingRatio[plane] = static_cast<double>(moving) / (width * ((height + 1 - field) / 2));
+        }
+    }
+
+    if (!fixedLength) {
+        for (int i = 0; i < 2; i++)
+            delete[] plut[i];
+    }
+    for (int i = 0; i < 3; i++)
+        delete[] ptlut[i];
+
+    *summary = allStatic ? maskAllStatic : (allMoving ? maskAllMoving : maskMixed);
+}
+
+template<typename T>
+static void buildMask(const TDMFrame * cSrc, const TDMFrame * oSrc, const TDMFrame & dst, const int cCount, const int oCount, const int order, const int field,
+                      int * summary, double * movingRatio, const TDeintModCore * d) noexcept {
+    switch (d->length) {
+    case 6: buildMaskKernel<T, 6>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 7: buildMaskKernel<T, 7>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 8: buildMaskKernel<T, 8>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 9: buildMaskKernel<T, 9>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 10: buildMaskKernel<T, 10>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 11: buildMaskKernel<T, 11>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 12: buildMaskKernel<T, 12>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 13: buildMaskKernel<T, 13>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 14: buildMaskKernel<T, 14>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 15: buildMaskKernel<T, 15>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 16: buildMaskKernel<T, 16>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    default: buildMaskKernel<T, 0>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d);
+    }
+}
+
+// Derives the chroma masks from the luma mask built by buildMask. A chroma pixel is moving if any luma pixel of the same field it covers is
+// moving, and otherwise takes the code of the first of them.
+template<typename T>
+static void chromaFromLuma(const TDMFrame & mask, const int field, double * movingRatio, const TDeintModCore * d) noexcept {
+    const int strideY = mask.stride[0] / sizeof(T);
+    const int heightY = mask.height[0];
+    const T * lumap = reinterpret_cast<const T *>(mask.ptr[0]);
+
+    for (int plane = 1; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            int64_t moving = 0;
+
+            const int width = mask.width[plane];
+            const int height = mask.height[plane];
+            const int stride = mask.stride[plane] / sizeof(T);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(mask.ptr[plane]);
+
+            for (int y = 0; y < height; y++) {
+                // chroma line y is line y / 2 of its field, which covers 1 << subSamplingH lines of the same field in luma
+                const int first = ((y >> 1) << (d->subSamplingH + 1)) + (y & 1);
+                const T * maskpY = lumap + strideY * first;
+                const T * maskpnY = lumap + strideY * std::min(first + 2 * d->subSamplingH, heightY - 2 + (y & 1));
+
+                for (int x = 0; x < width; x++) {
+                    const int xY = x << d->subSamplingW;
+                    const int xnY = xY + d->subSamplingW;
+                    const bool isMoving = maskpY[xY] == 60 || maskpY[xnY] == 60 || maskpnY[xY] == 60 || maskpnY[xnY] == 60;
+                    dstp[x] = isMoving ? 60 : maskpY[xY];
+                    if ((y & 1) == field)
+                        moving += isMoving;
+                }
+
+                dstp += stride;
+            }
+
+            movingRatio[plane] = static_cast<double>(moving) / (width * ((height + 1 - field) / 2));
+        }
+    }
+}
+
+template<typename T>
+static void setMaskForUpsize(const TDMFrame & mask, const int field, const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = mask.width[plane];
+            const int height = mask.height[plane] / 2;
+            const int stride = mask.stride[plane] / sizeof(T) * 2;
+            T * TDM_RESTRICT maskwc = reinterpret_cast<T *>(mask.ptr[plane]);
+            T * TDM_RESTRICT maskwn = maskwc + stride / 2;
+
+            if (field == 1) {
+                for (int y = 0; y < height - 1; y++) {
+                    std::fill_n(maskwc, width, static_cast<T>(10));
+                    std::fill_n(maskwn, width, static_cast<T>(60));
+                    maskwc += stride;
+                    maskwn += stride;
+                }
+                std::fill_n(maskwc, width, static_cast<T>(10));
+                std::fill_n(maskwn, width, static_cast<T>(10));
+            } else {
+                std::fill_n(maskwc, width, static_cast<T>(10));
+                std::fill_n(maskwn, width, static_cast<T>(10));
+                for (int y = 0; y < height - 1; y++) {
+                    maskwc += stride;
+                    maskwn += stride;
+                    std::fill_n(maskwc, width, static_cast<T>(60));
+                    std::fill_n(maskwn, width, static_cast<T>(10));
+                }
+            }
+        }
+    }
+}
+
+template<typename T>
+static void countInterpolated(const TDMFrame & mask, const int field, double * ratios, const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = mask.width[plane];
+            const int height = mask.height[plane];
+            const int stride = mask.stride[plane] / sizeof(T);
+            const T * maskp = reinterpret_cast<const T *>(mask.ptr[plane]) + stride * field;
+
+            int64_t count = 0;
+            for (int y = field; y < height; y += 2) {
+                for (int x = 0; x < width; x++)
+                    count += (maskp[x] == 60);
+
+                maskp += stride * 2;
+            }
+
+            ratios[plane] = static_cast<double>(count) / (width * ((height + 1 - field) / 2));
+        }
+    }
+}
+
+template<typename T>
+static void checkSpatial(const TDMFrame & src, const TDMFrame & dst, const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int stride = src.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            const T * srcppp = srcp - stride * 2;
+            const T * srcpp = srcp - stride;
+            const T * srcpn = srcp + stride;
+            const T * srcpnn = srcp + stride * 2;
+
+            if (d->metric == 0) {
+                for (int x = 0; x < width; x++) {
+                    const int sFirst = srcp[x] - srcpn[x];
+                    if (dstp[x] == 60 && !((sFirst > d->athresh || sFirst < -d->athresh) &&
+                                           std::abs(srcpnn[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpn[x] + srcpn[x])) > d->athresh6))
+                        dstp[x] = 10;
+                }
+                srcppp += stride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                srcpnn += stride;
+                dstp += dstStride;
+
+                for (int x = 0; x < width; x++) {
+                    const int sFirst = srcp[x] - srcpp[x];
+                    const int sSecond = srcp[x] - srcpn[x];
+                    if (dstp[x] == 60 && !(((sFirst > d->athresh && sSecond > d->athresh) || (sFirst < -d->athresh && sSecond < -d->athresh)) &&
+                                           std::abs(srcpnn[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpp[x] + srcpn[x])) > d->athresh6))
+                        dstp[x] = 10;
+                }
+                srcppp += stride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                srcpnn += stride;
+                dstp += dstStride;
+
+                for (int y = 2; y < height - 2; y++) {
+                    for (int x = 0; x < width; x++) {
+                        const int sFirst = srcp[x] - srcpp[x];
+                        const int sSecond = srcp[x] - srcpn[x];
+                        if (dstp[x] == 60 && !(((sFirst > d->athresh && sSecond > d->athresh) || (sFirst < -d->athresh && sSecond < -d->athresh)) &&
+                                               std::abs(srcppp[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpp[x] + srcpn[x])) > d->athresh6))
+                            dstp[x] = 10;
+                    }
+                    srcppp += stride;
+                    srcpp += stride;
+                    srcp += stride;
+                    srcpn += stride;
+                    srcpnn += stride;
+                    dstp += dstStride;
+                }
+
+                for (int x = 0; x < width; x++) {
+                    const int sFirst = srcp[x] - srcpp[x];
+                    const int sSecond = srcp[x] - srcpn[x];
+                    if (dstp[x] == 60 && !(((sFirst > d->athresh && sSecond > d->athresh) || (sFirst < -d->athresh && sSecond < -d->athresh)) &&
+                                           std::abs(srcppp[x] + srcp[x] * 4 + srcppp[x] - 3 * (srcpp[x] + srcpn[x])) > d->athresh6))
+                        dstp[x] = 10;
+                }
+                srcppp += stride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                srcpnn += stride;
+                dstp += dstStride;
+
+                for (int x = 0; x < width; x++) {
+                    const int sFirst = srcp[x] - srcpp[x];
+                    if (dstp[x] == 60 && !((sFirst > d->athresh || sFirst < -d->athresh) &&
+                                           std::abs(srcppp[x] + srcp[x] * 4 + srcppp[x] - 3 * (srcpp[x] + srcpp[x])) > d->athresh6))
+                        dstp[x] = 10;
+                }
+            } else {
+                for (int x = 0; x < width; x++) {
+                    if (dstp[x] == 60 && !((srcp[x] - srcpn[x]) * (srcp[x] - srcpn[x]) > d->athreshsq))
+                        dstp[x] = 10;
+                }
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                dstp += dstStride;
+
+                for (int y = 1; y < height - 1; y++) {
+                    for (int x = 0; x < width; x++) {
+                        if (dstp[x] == 60 && !((srcp[x] - srcpp[x]) * (srcp[x] - srcpn[x]) > d->athreshsq))
+                            dstp[x] = 10;
+                    }
+                    srcpp += stride;
+                    srcp += stride;
+                    srcpn += stride;
+                    dstp += dstStride;
+                }
+
+                for (int x = 0; x < width; x++) {
+                    if (dstp[x] == 60 && !((srcp[x] - srcpp[x]) * (srcp[x] - srcpp[x]) > d->athreshsq))
+                        dstp[x] = 10;
+                }
+            }
+        }
+    }
+}
+
+template<typename T>
+static void expandMask(const TDMFrame & mask, const int field, const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = mask.width[plane];
+            const int height = mask.height[plane];
+            const int stride = mask.stride[plane] / sizeof(T) * 2;
+            T * TDM_RESTRICT maskp = reinterpret_cast<T *>(mask.ptr[plane]) + stride / 2 * field;
+
+            const int dis = d->expand >> (plane ? d->subSamplingW : 0);
+
+            for (int y = field; y < height; y += 2) {
+                for (int x = 0; x < width; x++) {
+                    if (maskp[x] == 60) {
+                        int xt = x - 1;
+                        while (xt >= 0 && xt >= x - dis)
+                            maskp[xt--] = 60;
+                        xt = x + 1;
+
+                        int nc = x + dis + 1;
+                        while (xt < width && xt <= x + dis) {
+                            if (maskp[xt] == 60) {
+                                nc = xt;
+                                break;
+                            } else {
+                                maskp[xt++] = 60;
+                            }
+                        }
+                        x = nc - 1;
+                    }
+                }
+
+                maskp += stride;
+            }
+        }
+    }
+}
+
+template<typename T>
+static void linkMask(const TDMFrame & mask, const int field, const TDeintModCore * d) noexcept {
+    const int width = mask.width[2];
+    const int height = mask.height[2];
+    const int strideY = mask.stride[0] / sizeof(T);
+    const int strideUV = mask.stride[2] / sizeof(T);
+    const T * maskpY = reinterpret_cast<const T *>(mask.ptr[0]) + strideY * field;
+    T * TDM_RESTRICT maskpU = reinterpret_cast<T *>(mask.ptr[1]) + strideUV * field;
+    T * TDM_RESTRICT maskpV = reinterpret_cast<T *>(mask.ptr[2]) + strideUV * field;
+
+    const T * maskpnY = maskpY + strideY * 2;
+
+    const int strideY2 = strideY * (2 << d->subSamplingH);
+    const int strideUV2 = strideUV * 2;
+
+    for (int y = field; y < height; y += 2) {
+        for (int x = 0; x < width; x++) {
+            if (d->subSamplingW == 0) {
+                if (d->subSamplingH == 0) {
+                    if (maskpY[x] == 0x3C)
+                        maskpU[x] = maskpV[x] = 0x3C;
+                } else {
+                    if (maskpY[x] == 0x3C && maskpnY[x] == 0x3C)
+                        maskpU[x] = maskpV[x] = 0x3C;
+                }
+            } else {
+                if (std::is_same<T, uint8_t>::value) {
+                    if (d->subSamplingH == 0) {
+                        if (reinterpret_cast<const uint16_t *>(maskpY)[x] == 0x3C3C)
+                            maskpU[x] = maskpV[x] = 0x3C;
+                    } else {
+                        if (reinterpret_cast<const uint16_t *>(maskpY)[x] == 0x3C3C && reinterpret_cast<const uint16_t *>(maskpnY)[x] == 0x3C3C)
+                            maskpU[x] = maskpV[x] = 0x3C;
+                    }
+                } else {
+                    if (d->subSamplingH == 0) {
+                        if (reinterpret_cast<const uint32_t *>(maskpY)[x] == 0x3C003C)
+                            maskpU[x] = maskpV[x] = 0x3C;
+                    } else {
+                        if (reinterpret_cast<const uint32_t *>(maskpY)[x] == 0x3C003C && reinterpret_cast<const uint32_t *>(maskpnY)[x] == 0x3C003C)
+                            maskpU[x] = maskpV[x] = 0x3C;
+                    }
+                }
+            }
+        }
+
+        maskpY += strideY2;
+        maskpnY += strideY2;
+        maskpU += strideUV2;
+        maskpV += strideUV2;
+    }
+}
+
+template<typename T>
+static void eDeint(const TDMFrame & dst, const TDMFrame & mask, const TDMFrame & prv, const TDMFrame & src, const TDMFrame & nxt, const TDMFrame & edeint,
+                   const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int prvStride = prv.stride[plane] / sizeof(T);
+            const int srcStride = src.stride[plane] / sizeof(T);
+            const int nxtStride = nxt.stride[plane] / sizeof(T);
+            const int maskStride = mask.stride[plane] / sizeof(T);
+            const int edeintStride = edeint.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * prvp = reinterpret_cast<const T *>(prv.ptr[plane]);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            const T * nxtp = reinterpret_cast<const T *>(nxt.ptr[plane]);
+            const T * maskp = reinterpret_cast<const T *>(mask.ptr[plane]);
+            const T * edeintp = reinterpret_cast<const T *>(edeint.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    if (maskp[x] == 10)
+                        dstp[x] = srcp[x];
+                    else if (maskp[x] == 20)
+                        dstp[x] = prvp[x];
+                    else if (maskp[x] == 30)
+                        dstp[x] = nxtp[x];
+                    else if (maskp[x] == 40)
+                        dstp[x] = (srcp[x] + nxtp[x] + 1) >> 1;
+                    else if (maskp[x] == 50)
+                        dstp[x] = (srcp[x] + prvp[x] + 1) >> 1;
+                    else if (maskp[x] == 70)
+                        dstp[x] = (prvp[x] + srcp[x] * 2 + nxtp[x] + 2) >> 2;
+                    else if (maskp[x] == 60)
+                        dstp[x] = edeintp[x];
+                }
+
+                prvp += prvStride;
+                srcp += srcStride;
+                nxtp += nxtStride;
+                maskp += maskStride;
+                edeintp += edeintStride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+template<typename T>
+static void cubicDeint(const TDMFrame & dst, const TDMFrame & mask, const TDMFrame & prv, const TDMFrame & src, const TDMFrame & nxt,
+                       const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int prvStride = prv.stride[plane] / sizeof(T);
+            const int stride = src.stride[plane] / sizeof(T);
+            const int nxtStride = nxt.stride[plane] / sizeof(T);
+            const int maskStride = mask.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * prvp = reinterpret_cast<const T *>(prv.ptr[plane]);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            const T * nxtp = reinterpret_cast<const T *>(nxt.ptr[plane]);
+            const T * maskp = reinterpret_cast<const T *>(mask.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            const T * srcpp = srcp - stride;
+            const T * srcppp = srcpp - stride * 2;
+            const T * srcpn = srcp + stride;
+            const T * srcpnn = srcpn + stride * 2;
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    if (maskp[x] == 10)
+                        dstp[x] = srcp[x];
+                    else if (maskp[x] == 20)
+                        dstp[x] = prvp[x];
+                    else if (maskp[x] == 30)
+                        dstp[x] = nxtp[x];
+                    else if (maskp[x] == 40)
+                        dstp[x] = (srcp[x] + nxtp[x] + 1) >> 1;
+                    else if (maskp[x] == 50)
+                        dstp[x] = (srcp[x] + prvp[x] + 1) >> 1;
+                    else if (maskp[x] == 70)
+                        dstp[x] = (prvp[x] + srcp[x] * 2 + nxtp[x] + 2) >> 2;
+                    else if (maskp[x] == 60) {
+                        if (y == 0) {
+                            dstp[x] = srcpn[x];
+                        } else if (y == height - 1) {
+                            dstp[x] = srcpp[x];
+                        } else if (y < 3 || y > height - 4) {
+                            dstp[x] = (srcpn[x] + srcpp[x] + 1) >> 1;
+                        } else {
+                            const int temp = (19 * (srcpp[x] + srcpn[x]) - 3 * (srcppp[x] + srcpnn[x]) + 16) >> 5;
+                            dstp[x] = std::min(std::max(temp, 0), d->peak);
+                        }
+                    }
+                }
+
+                prvp += prvStride;
+                srcppp += stride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                srcpnn += stride;
+                nxtp += nxtStride;
+                maskp += maskStride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+// Edge-directed interpolation of a pixel from the lines above and below it, which must have two readable samples on each side. The pixels
+// along the direction whose three pixel window differs the least are averaged, and the result is kept within the vertical pair.
+template<typename T>
+static inline T elaPixel(const T * a, const T * b) noexcept {
+    const int cost = std::abs(a[-1] - b[-1]) + std::abs(a[0] - b[0]) + std::abs(a[1] - b[1]);
+    const int costLeft = std::abs(a[-2] - b[0]) + std::abs(a[-1] - b[1]) + std::abs(a[0] - b[2]);
+    const int costRight = std::abs(a[0] - b[-2]) + std::abs(a[1] - b[-1]) + std::abs(a[2] - b[0]);
+
+    int result = (a[0] + b[0] + 1) >> 1;
+    if (costLeft < cost)
+        result = (a[-1] + b[1] + 1) >> 1;
+    if (costRight < std::min(cost, costLeft))
+        result = (a[1] + b[-1] + 1) >> 1;
+    return std::min(std::max(result, std::min<int>(a[0], b[0])), std::max<int>(a[0], b[0]));
+}
+
+// Interpolates pixels [x0, x1) of a line with elaPixel, repeating the outermost samples of the lines above and below at the edges
+template<typename T>
+static void elaRun(T * TDM_RESTRICT dstp, const T * srcpp, const T * srcpn, const int x0, const int x1, const int width) noexcept {
+    const int start = std::min(std::max(x0, 2), x1);
+    const int stop = std::max(std::min(x1, width - 2), start);
+
+    const auto edge = [&](const int x) {
+        T a[5], b[5];
+        for (int i = 0; i < 5; i++) {
+            const int pos = std::min(std::max(x + i - 2, 0), width - 1);
+            a[i] = srcpp[pos];
+            b[i] = srcpn[pos];
+        }
+        return elaPixel(a + 2, b + 2);
+    };
+
+    for (int x = x0; x < start; x++)
+        dstp[x] = edge(x);
+    for (int x = start; x < stop; x++)
+        dstp[x] = elaPixel(srcpp + x, srcpn + x);
+    for (int x = stop; x < x1; x++)
+        dstp[x] = edge(x);
+}
+
+template<typename T>
+static void elaDeint(const TDMFrame & dst, const TDMFrame & mask, const TDMFrame & prv, const TDMFrame & src, const TDMFrame & nxt,
+                     const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int prvStride = prv.stride[plane] / sizeof(T);
+            const int stride = src.stride[plane] / sizeof(T);
+            const int nxtStride = nxt.stride[plane] / sizeof(T);
+            const int maskStride = mask.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * prvp = reinterpret_cast<const T *>(prv.ptr[plane]);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            const T * nxtp = reinterpret_cast<const T *>(nxt.ptr[plane]);
+            const T * maskp = reinterpret_cast<const T *>(mask.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            const T * srcpp = srcp - stride;
+            const T * srcpn = srcp + stride;
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    if (maskp[x] == 10)
+                        dstp[x] = srcp[x];
+                    else if (maskp[x] == 20)
+                        dstp[x] = prvp[x];
+                    else if (maskp[x] == 30)
+                        dstp[x] = nxtp[x];
+                    else if (maskp[x] == 40)
+                        dstp[x] = (srcp[x] + nxtp[x] + 1) >> 1;
+                    else if (maskp[x] == 50)
+                        dstp[x] = (srcp[x] + prvp[x] + 1) >> 1;
+                    else if (maskp[x] == 70)
+                        dstp[x] = (prvp[x] + srcp[x] * 2 + nxtp[x] + 2) >> 2;
+                    else if (maskp[x] == 60) {
+                        // the run of moving pixels is interpolated in one call, which keeps the edge handling out of the inner loop
+                        int end = x + 1;
+                        while (end < width && maskp[end] == 60)
+                            end++;
+
+                        if (y == 0)
+                            memcpy(dstp + x, srcpn + x, (end - x) * sizeof(T));
+                        else if (y == height - 1)
+                            memcpy(dstp + x, srcpp + x, (end - x) * sizeof(T));
+                        else
+                            elaRun(dstp, srcpp, srcpn, x, end, width);
+                        x = end - 1;
+                    }
+                }
+
+                prvp += prvStride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                nxtp += nxtStride;
+                maskp += maskStride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+template<typename T>
+static void bobDeint(const TDMFrame & dst, const TDMFrame & src, const TDMFrame * edeint, const int field, const bool keepEdges,
+                     const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int stride = src.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            tdmBitblt(dstp + dstStride * (1 - field), dst.stride[plane] * 2, srcp + stride * (1 - field), src.stride[plane] * 2,
+                      width * sizeof(T), (height + field) / 2);
+
+            if (edeint) {
+                const uint8_t * edeintp = edeint->ptr[plane] + edeint->stride[plane] * field;
+                tdmBitblt(dstp + dstStride * field, dst.stride[plane] * 2, edeintp, edeint->stride[plane] * 2,
+                          width * sizeof(T), (height + 1 - field) / 2);
+            } else {
+                const T * srcpc = srcp + stride * field;
+                T * TDM_RESTRICT dstpc = dstp + dstStride * field;
+
+                const T * srcpp = srcpc - stride;
+                const T * srcppp = srcpp - stride * 2;
+                const T * srcpn = srcpc + stride;
+                const T * srcpnn = srcpn + stride * 2;
+
+                for (int y = field; y < height; y += 2) {
+                    if (y == 0) {
+                        memcpy(dstpc, srcpn, width * sizeof(T));
+                    } else if (y == height - 1) {
+                        memcpy(dstpc, srcpp, width * sizeof(T));
+                    } else if (d->type == 1) {
+                        elaRun(dstpc, srcpp, srcpn, 0, width, width);
+                    } else if (y < 3 || y > height - 4) {
+                        for (int x = 0; x < width; x++)
+                            dstpc[x] = (srcpn[x] + srcpp[x] + 1) >> 1;
+                    } else {
+                        for (int x = 0; x < width; x++) {
+                            const int temp = (19 * (srcpp[x] + srcpn[x]) - 3 * (srcppp[x] + srcpnn[x]) + 16) >> 5;
+                            dstpc[x] = std::min(std::max(temp, 0), d->peak);
+                        }
+                    }
+
+                    srcppp += stride * 2;
+                    srcpp += stride * 2;
+                    srcpn += stride * 2;
+                    srcpnn += stride * 2;
+                    dstpc += dstStride * 2;
+                }
+            }
+
+            // the upsize mask used for dumb bobbing keeps the outermost lines of the interpolated field
+            if (keepEdges) {
+                if (field == 0)
+                    memcpy(dstp, srcp, width * sizeof(T));
+                else if (!(height & 1))
+                    memcpy(dstp + dstStride * (height - 1), srcp + stride * (height - 1), width * sizeof(T));
+            }
+        }
+    }
+}
+
+template<typename T>
+static void binaryMask(const TDMFrame & src, const TDMFrame & dst, const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int srcStride = src.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++)
+                    dstp[x] = (srcp[x] == 60) ? d->peak : 0;
+
+                srcp += srcStride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+template<typename T>
+static bool checkCombed(const TDMFrame & src, const TDMFrame & cmask, int * TDM_RESTRICT cArray, const IsCombedCore * d) noexcept {
+    constexpr T peak = std::numeric_limits<T>::max();
+
+    for (int plane = 0; plane < (d->chroma ? 3 : 1); plane++) {
+        const int width = src.width[plane];
+        const int height = src.height[plane];
+        const int stride = src.stride[plane] / sizeof(T);
+        const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+        T * TDM_RESTRICT cmkp = reinterpret_cast<T *>(cmask.ptr[plane]);
+
+        const T * srcppp = srcp - stride * 2;
+        const T * srcpp = srcp - stride;
+        const T * srcpn = srcp + stride;
+        const T * srcpnn = srcp + stride * 2;
+
+        memset(cmkp, 0, cmask.stride[plane] * height);
+
+        if (d->metric == 0) {
+            for (int x = 0; x < width; x++) {
+                const int sFirst = srcp[x] - srcpn[x];
+                if ((sFirst > d->cthresh || sFirst < -d->cthresh) && std::abs(srcpnn[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpn[x] + srcpn[x])) > d->cthresh6)
+                    cmkp[x] = peak;
+            }
+            srcppp += stride;
+            srcpp += stride;
+            srcp += stride;
+            srcpn += stride;
+            srcpnn += stride;
+            cmkp += stride;
+
+            for (int x = 0; x < width; x++) {
+                const int sFirst = srcp[x] - srcpp[x];
+                const int sSecond = srcp[x] - srcpn[x];
+                if (((sFirst > d->cthresh && sSecond > d->cthresh) || (sFirst < -d->cthresh && sSecond < -d->cthresh)) &&
+                    std::abs(srcpnn[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpp[x] + srcpn[x])) > d->cthresh6)
+                    cmkp[x] = peak;
+            }
+            srcppp += stride;
+            srcpp += stride;
+            srcp += stride;
+            srcpn += stride;
+            srcpnn += stride;
+            cmkp += stride;
+
+            for (int y = 2; y < height - 2; y++) {
+                for (int x = 0; x < width; x++) {
+                    const int sFirst = srcp[x] - srcpp[x];
+                    const int sSecond = srcp[x] - srcpn[x];
+                    if (((sFirst > d->cthresh && sSecond > d->cthresh) || (sFirst < -d->cthresh && sSecond < -d->cthresh)) &&
+                        std::abs(srcppp[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpp[x] + srcpn[x])) > d->cthresh6)
+                        cmkp[x] = peak;
+                }
+                srcppp += stride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                srcpnn += stride;
+                cmkp += stride;
+            }
+
+            for (int x = 0; x < width; x++) {
+                const int sFirst = srcp[x] - srcpp[x];
+                const int sSecond = srcp[x] - srcpn[x];
+                if (((sFirst > d->cthresh && sSecond > d->cthresh) || (sFirst < -d->cthresh && sSecond < -d->cthresh)) &&
+                    std::abs(srcppp[x] + srcp[x] * 4 + srcppp[x] - 3 * (srcpp[x] + srcpn[x])) > d->cthresh6)
+                    cmkp[x] = peak;
+            }
+            srcppp += stride;
+            srcpp += stride;
+            srcp += stride;
+            srcpn += stride;
+            srcpnn += stride;
+            cmkp += stride;
+
+            for (int x = 0; x < width; x++) {
+                const int sFirst = srcp[x] - srcpp[x];
+                if ((sFirst > d->cthresh || sFirst < -d->cthresh) && std::abs(srcppp[x] + srcp[x] * 4 + srcppp[x] - 3 * (srcpp[x] + srcpp[x])) > d->cthresh6)
+                    cmkp[x] = peak;
+            }
+        } else {
+            for (int x = 0; x < width; x++) {
+                if ((srcp[x] - srcpn[x]) * (srcp[x] - srcpn[x]) > d->cthreshsq)
+                    cmkp[x] = peak;
+            }
+            srcpp += stride;
+            srcp += stride;
+            srcpn += stride;
+            cmkp += stride;
+
+            for (int y = 1; y < height - 1; y++) {
+                for (int x = 0; x < width; x++) {
+                    if ((srcp[x] - srcpp[x]) * (srcp[x] - srcpn[x]) > d->cthreshsq)
+                        cmkp[x] = peak;
+                }
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                cmkp += stride;
+            }
+
+            for (int x = 0; x < width; x++) {
+                if ((srcp[x] - srcpp[x]) * (srcp[x] - srcpp[x]) > d->cthreshsq)
+                    cmkp[x] = peak;
+            }
+        }
+    }
+
+    if (d->chroma) {
+        const int width = cmask.width[2];
+        const int height = cmask.height[2];
+        const int stride = cmask.stride[0] / sizeof(T);
+        const int strideY = stride << d->subSamplingH;
+        const int strideUV = cmask.stride[2] / sizeof(T);
+        T * TDM_RESTRICT cmkp = reinterpret_cast<T *>(cmask.ptr[0]);
+        const T * cmkpU = reinterpret_cast<const T *>(cmask.ptr[1]);
+        const T * cmkpV = reinterpret_cast<const T *>(cmask.ptr[2]);
+
+        T * TDM_RESTRICT cmkpp3 = cmkp - stride * 3;
+        T * TDM_RESTRICT cmkpp2 = cmkp - stride * 2;
+        T * TDM_RESTRICT cmkpp = cmkp - stride;
+        T * TDM_RESTRICT cmkpn = cmkp + stride;
+        T * TDM_RESTRICT cmkpn2 = cmkp + stride * 2;
+        const T * cmkppU = cmkpU - strideUV;
+        const T * cmkpnU = cmkpU + strideUV;
+        const T * cmkppV = cmkpV - strideUV;
+        const T * cmkpnV = cmkpV + strideUV;
+
+        for (int y = 1; y < height - 1; y++) {
+            cmkpp3 += strideY;
+            cmkpp2 += strideY;
+            cmkpp += strideY;
+            cmkp += strideY;
+            cmkpn += strideY;
+            cmkpn2 += strideY;
+            cmkppU += strideUV;
+            cmkpU += strideUV;
+            cmkpnU += strideUV;
+            cmkppV += strideUV;
+            cmkpV += strideUV;
+            cmkpnV += strideUV;
+
+            for (int x = 1; x < width - 1; x++) {
+                if ((cmkpU[x] && (cmkpU[x - 1] || cmkpU[x + 1] || cmkppU[x - 1] || cmkppU[x] || cmkppU[x + 1] || cmkpnU[x - 1] || cmkpnU[x] || cmkpnU[x + 1])) ||
+                    (cmkpV[x] && (cmkpV[x - 1] || cmkpV[x + 1] || cmkppV[x - 1] || cmkppV[x] || cmkppV[x + 1] || cmkpnV[x - 1] || cmkpnV[x] || cmkpnV[x + 1]))) {
+                    if (d->subSamplingW == 0) {
+                        cmkp[x] = peak;
+
+                        if (d->subSamplingH > 0) {
+                            cmkpn[x] = peak;
+                            (y & 1 ? cmkpp : cmkpn2)[x] = peak;
+
+                            if (d->subSamplingH == 2) {
+                                cmkpp2[x] = peak;
+                                (y & 1 ? cmkpp3 : cmkpp)[x] = peak;
+                            }
+                        }
+                    } else if (d->subSamplingW == 1) {
+                        if (std::is_same<T, uint8_t>::value) {
+                            constexpr uint16_t peak2 = std::numeric_limits<uint16_t>::max();
+                            reinterpret_cast<uint16_t *>(cmkp)[x] = peak2;
+
+                            if (d->subSamplingH > 0) {
+                                reinterpret_cast<uint16_t *>(cmkpn)[x] = peak2;
+                                reinterpret_cast<uint16_t *>(y & 1 ? cmkpp : cmkpn2)[x] = peak2;
+
+                                if (d->subSamplingH == 2) {
+                                    reinterpret_cast<uint16_t *>(cmkpp2)[x] = peak2;
+                                    reinterpret_cast<uint16_t *>(y & 1 ? cmkpp3 : cmkpp)[x] = peak2;
+                                }
+                            }
+                        } else {
+                            constexpr uint32_t peak2 = std::numeric_limits<uint32_t>::max();
+                            reinterpret_cast<uint32_t *>(cmkp)[x] = peak2;
+
+                            if (d->subSamplingH > 0) {
+                                reinterpret_cast<uint32_t *>(cmkpn)[x] = peak2;
+                                reinterpret_cast<uint32_t *>(y & 1 ? cmkpp : cmkpn2)[x] = peak2;
+
+                                if (d->subSamplingH == 2) {
+                                    reinterpret_cast<uint32_t *>(cmkpp2)[x] = peak2;
+                                    reinterpret_cast<uint32_t *>(y & 1 ? cmkpp3 : cmkpp)[x] = peak2;
+                                }
+                            }
+                        }
+                    } else {
+                        if (std::is_same<T, uint8_t>::value) {
+                            constexpr uint32_t peak2 = std::numeric_limits<uint32_t>::max();
+                            reinterpret_cast<uint32_t *>(cmkp)[x] = peak2;
+
+                            if (d->subSamplingH > 0) {
+                                reinterpret_cast<uint32_t *>(cmkpn)[x] = peak2;
+                                reinterpret_cast<uint32_t *>(y & 1 ? cmkpp : cmkpn2)[x] = peak2;
+
+                                if (d->subSamplingH == 2) {
+                                    reinterpret_cast<uint32_t *>(cmkpp2)[x] = peak2;
+                                    reinterpret_cast<uint32_t *>(y & 1 ? cmkpp3 : cmkpp)[x] = peak2;
+                                }
+                            }
+                        } else {
+                            constexpr uint64_t peak2 = std::numeric_limits<uint64_t>::max();
+                            reinterpret_cast<uint64_t *>(cmkp)[x] = peak2;
+
+                            if (d->subSamplingH > 0) {
+                                reinterpret_cast<uint64_t *>(cmkpn)[x] = peak2;
+                                reinterpret_cast<uint64_t *>(y & 1 ? cmkpp : cmkpn2)[x] = peak2;
+
+                                if (d->subSamplingH == 2) {
+                                    reinterpret_cast<uint64_t *>(cmkpp2)[x] = peak2;
+                                    reinterpret_cast<uint64_t *>(y & 1 ? cmkpp3 : cmkpp)[x] = peak2;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const int width = cmask.width[0];
+    const int height = cmask.height[0];
+    const int stride = cmask.stride[0] / sizeof(T);
+    const T * cmkp = reinterpret_cast<const T *>(cmask.ptr[0]) + stride;
+
+    const T * cmkpp = cmkp - stride;
+    const T * cmkpn = cmkp + stride;
+
+    memset(cArray, 0, d->arraySize * sizeof(int));
+
+    for (int y = 1; y < d->yHalf; y++) {
+        const int temp1 = (y >> d->yShift) * d->xBlocks4;
+        const int temp2 = ((y + d->yHalf) >> d->yShift) * d->xBlocks4;
+
+        for (int x = 0; x < width; x++) {
+            if (cmkpp[x] && cmkp[x] && cmkpn[x]) {
+                const int box1 = (x >> d->xShift) * 4;
+                const int box2 = ((x + d->xHalf) >> d->xShift) * 4;
+                ++cArray[temp1 + box1];
+                ++cArray[temp1 + box2 + 1];
+                ++cArray[temp2 + box1 + 2];
+                ++cArray[temp2 + box2 + 3];
+            }
+        }
+
+        cmkpp += stride;
+        cmkp += stride;
+        cmkpn += stride;
+    }
+
+    for (int y = d->yHalf; y < d->heighta; y += d->yHalf) {
+        const int temp1 = (y >> d->yShift) * d->xBlocks4;
+        const int temp2 = ((y + d->yHalf) >> d->yShift) * d->xBlocks4;
+
+        for (int x = 0; x < d->widtha; x += d->xHalf) {
+            const T * cmkppT = cmkpp;
+            const T * cmkpT = cmkp;
+            const T * cmkpnT = cmkpn;
+            int sum = 0;
+
+            for (int u = 0; u < d->yHalf; u++) {
+                for (int v = 0; v < d->xHalf; v++) {
+                    if (cmkppT[x + v] && cmkpT[x + v] && cmkpnT[x + v])
+                        sum++;
+                }
+                cmkppT += stride;
+                cmkpT += stride;
+                cmkpnT += stride;
+            }
+
+            if (sum) {
+                const int box1 = (x >> d->xShift) * 4;
+                const int box2 = ((x + d->xHalf) >> d->xShift) * 4;
+                cArray[temp1 + box1] += sum;
+                cArray[temp1 + box2 + 1] += sum;
+                cArray[temp2 + box1 + 2] += sum;
+                cArray[temp2 + box2 + 3] += sum;
+            }
+        }
+
+        for (int x = d->widtha; x < width; x++) {
+            const T * cmkppT = cmkpp;
+            const T * cmkpT = cmkp;
+            const T * cmkpnT = cmkpn;
+            int sum = 0;
+
+            for (int u = 0; u < d->yHalf; u++) {
+                if (cmkppT[x] && cmkpT[x] && cmkpnT[x])
+                    sum++;
+                cmkppT += stride;
+                cmkpT += stride;
+                cmkpnT += stride;
+            }
+
+            if (sum) {
+                const int box1 = (x >> d->xShift) * 4;
+                const int box2 = ((x + d->xHalf) >> d->xShift) * 4;
+                cArray[temp1 + box1] += sum;
+                cArray[temp1 + box2 + 1] += sum;
+                cArray[temp2 + box1 + 2] += sum;
+                cArray[temp2 + box2 + 3] += sum;
+            }
+        }
+
+        cmkpp += stride * d->yHalf;
+        cmkp += stride * d->yHalf;
+        cmkpn += stride * d->yHalf;
+    }
+
+    for (int y = d->heighta; y < height - 1; y++) {
+        const int temp1 = (y >> d->yShift) * d->xBlocks4;
+        const int temp2 = ((y + d->yHalf) >> d->yShift) * d->xBlocks4;
+
+        for (int x = 0; x < width; x++) {
+            if (cmkpp[x] && cmkp[x] && cmkpn[x]) {
+                const int box1 = (x >> d->xShift) * 4;
+                const int box2 = ((x + d->xHalf) >> d->xShift) * 4;
+                ++cArray[temp1 + box1];
+                ++cArray[temp1 + box2 + 1];
+                ++cArray[temp2 + box1 + 2];
+                ++cArray[temp2 + box2 + 3];
+            }
+        }
+
+        cmkpp += stride;
+        cmkp += stride;
+        cmkpn += stride;
+    }
+
+    int MIC = 0;
+    for (int x = 0; x < d->arraySize; x++) {
+        if (cArray[x] > MIC)
+            MIC = cArray[x];
+    }
+    return MIC > d->MI;
+}
+
+// Points the kernels at the copies of the including translation unit
+static inline void selectGenericKernels(TDeintModCore * d) noexcept {
+    if (d->bitsPerSample <= 8) {
+        d->buildMask = buildMask<uint8_t>;
+        d->chromaFromLuma = chromaFromLuma<uint8_t>;
+        d->setMaskForUpsize = setMaskForUpsize<uint8_t>;
+        d->countInterpolated = countInterpolated<uint8_t>;
+        d->checkSpatial = checkSpatial<uint8_t>;
+        d->expandMask = expandMask<uint8_t>;
+        d->linkMask = linkMask<uint8_t>;
+        d->eDeint = eDeint<uint8_t>;
+        d->cubicDeint = cubicDeint<uint8_t>;
+        d->elaDeint = elaDeint<uint8_t>;
+        d->bobDeint = bobDeint<uint8_t>;
+        d->binaryMask = binaryMask<uint8_t>;
+    } else {
+        d->buildMask = buildMask<uint16_t>;
+        d->chromaFromLuma = chromaFromLuma<uint16_t>;
+        d->setMaskForUpsize = setMaskForUpsize<uint16_t>;
+        d->countInterpolated = countInterpolated<uint16_t>;
+        d->checkSpatial = checkSpatial<uint16_t>;
+        d->expandMask = expandMask<uint16_t>;
+        d->linkMask = linkMask<uint16_t>;
+        d->eDeint = eDeint<uint16_t>;
+        d->cubicDeint = cubicDeint<uint16_t>;
+        d->elaDeint = elaDeint<uint16_t>;
+        d->bobDeint = bobDeint<uint16_t>;
+        d->binaryMask = binaryMask<uint16_t>;
+    }
+}
+
+static inline void selectGenericKernels(IsCombedCore * d, const int bitsPerSample) noexcept {
+    d->checkCombed = (bitsPerSample <= 8) ? checkCombed<uint8_t> : checkCombed<uint16_t>;
+}
@@ -0,0 +1,13 @@
+#ifdef VS_TARGET_CPU_X86
+#include "TDeintModKernels.hpp"
+
+// Only the generic kernels are built for AVX-512, the motion mask kernels of this tier are the AVX2 ones
+
+void selectGenericKernels_avx512(TDeintModCore * d) noexcept {
+    selectGenericKernels(d);
+}
+
+void selectGenericKernels_avx512(IsCombedCore * d, const int bitsPerSample) noexcept {
+    selectGenericKernels(d, bitsPerSample);
+}
+#endif
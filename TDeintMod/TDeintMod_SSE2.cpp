@@ -1,49 +1,57 @@
 #ifdef VS_TARGET_CPU_X86
-#include "TDeintMod.hpp"
+#include "TDeintModCore.hpp"
 
 template<typename T>
 static inline T abs_dif(const T & a, const T & b) noexcept {
     return sub_saturated(a, b) | sub_saturated(b, a);
 }
 
+// Loads the horizontal neighbors of srcp[x .. x + step - 1], mirroring them at the left and right edges of the row
 template<typename T1, typename T2, int step>
-void threshMask_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+static inline void loadNeighbors(const T1 * srcp, const int x, const int width, T2 & left, T2 & right) noexcept {
+    if (x > 0 && x + step < width) {
+        left.load(srcp + x - 1);
+        right.load(srcp + x + 1);
+    } else {
+        T1 temp[step + 2];
+        std::copy_n(srcp + x, step, temp + 1);
+        temp[0] = srcp[x ? x - 1 : 1];
+        temp[step + 1] = (x + step < width) ? srcp[x + step] : 0;
+        if (x + step >= width)
+            temp[width - x + 1] = srcp[width - 2];
+        left.load(temp);
+        right.load(temp + 2);
+    }
+}
+
+template<typename T1, typename T2, int step, bool fixedQ, bool fixedH>
+static void threshMaskKernel_sse2(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
     constexpr T1 peak = std::numeric_limits<T1>::max();
 
-    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = d->vi.height >> (plane ? d->vi.format->subSamplingH : 0);
-    const int stride = vsapi->getStride(src, 0) / sizeof(T1);
-    const T1 * srcp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src, 0)) + d->widthPad;
-    T1 * dstp0 = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
-    T1 * dstp1 = dstp0 + stride * height;
-
-    if (plane == 0 && d->mtqL > -1 && d->mthL > -1) {
-        std::fill_n(dstp0 - d->widthPad, stride * height, static_cast<T1>(d->mtqL));
-        std::fill_n(dstp1 - d->widthPad, stride * height, static_cast<T1>(d->mthL));
-        return;
-    } else if (plane > 0 && d->mtqC > -1 && d->mthC > -1) {
-        std::fill_n(dstp0 - d->widthPad, stride * height, static_cast<T1>(d->mtqC));
-        std::fill_n(dstp1 - d->widthPad, stride * height, static_cast<T1>(d->mthC));
-        return;
-    }
+    const int width = src.width[plane];
+    const int height = src.height[plane];
+    const int srcStride = src.stride[plane] / sizeof(T1);
+    const int dstStride = dst.stride[0] / sizeof(T1);
+    const T1 * srcp = reinterpret_cast<const T1 *>(src.ptr[plane]);
+    T1 * dstp0 = reinterpret_cast<T1 *>(dst.ptr[0]);
+    T1 * dstp1 = dstp0 + dstStride * height;
 
-    const T1 * srcpp = srcp + stride;
+    const T1 * srcpp = srcp + srcStride;
     const T1 * srcpn = srcpp;
 
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x += step) {
-            const T2 topLeft = T2().load(srcpp + x - 1);
+            T2 topLeft, topRight, left, right, bottomLeft, bottomRight;
+            loadNeighbors<T1, T2, step>(srcpp, x, width, topLeft, topRight);
+            loadNeighbors<T1, T2, step>(srcp, x, width, left, right);
+            loadNeighbors<T1, T2, step>(srcpn, x, width, bottomLeft, bottomRight);
             const T2 top = T2().load_a(srcpp + x);
-            const T2 topRight = T2().load(srcpp + x + 1);
-            const T2 left = T2().load(srcp + x - 1);
             const T2 center = T2().load_a(srcp + x);
-            const T2 right = T2().load(srcp + x + 1);
-            const T2 bottomLeft = T2().load(srcpn + x - 1);
             const T2 bottom = T2().load_a(srcpn + x);
-            const T2 bottomRight = T2().load(srcpn + x + 1);
 
             T2 min0 = peak, max0 = zero_128b();
             T2 min1 = peak, max1 = zero_128b();
+            T2 at;
 
             if (d->ttype == 0) { // 4 neighbors - compensated
                 min0 = min(min0, top);
@@ -57,9 +65,7 @@ void threshMask_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane,
 
                 const T2 atv = max((abs_dif<T2>(center, min0) + d->vHalf[plane]) >> d->vShift[plane], (abs_dif<T2>(center, max0) + d->vHalf[plane]) >> d->vShift[plane]);
                 const T2 ath = max((abs_dif<T2>(center, min1) + d->hHalf[plane]) >> d->hShift[plane], (abs_dif<T2>(center, max1) + d->hHalf[plane]) >> d->hShift[plane]);
-                const T2 atmax = max(atv, ath);
-                ((atmax + 2) >> 2).stream(dstp0 + x);
-                ((atmax + 1) >> 1).stream(dstp1 + x);
+                at = max(atv, ath);
             } else if (d->ttype == 1) { // 8 neighbors - compensated
                 min0 = min(min0, topLeft);
                 max0 = max(max0, topLeft);
@@ -80,9 +86,7 @@ void threshMask_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane,
 
                 const T2 atv = max((abs_dif<T2>(center, min0) + d->vHalf[plane]) >> d->vShift[plane], (abs_dif<T2>(center, max0) + d->vHalf[plane]) >> d->vShift[plane]);
                 const T2 ath = max((abs_dif<T2>(center, min1) + d->hHalf[plane]) >> d->hShift[plane], (abs_dif<T2>(center, max1) + d->hHalf[plane]) >> d->hShift[plane]);
-                const T2 atmax = max(atv, ath);
-                ((atmax + 2) >> 2).stream(dstp0 + x);
-                ((atmax + 1) >> 1).stream(dstp1 + x);
+                at = max(atv, ath);
             } else if (d->ttype == 2) { // 4 neighbors - not compensated
                 min0 = min(min0, top);
                 max0 = max(max0, top);
@@ -93,9 +97,7 @@ void threshMask_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane,
                 min0 = min(min0, bottom);
                 max0 = max(max0, bottom);
 
-                const T2 at = max(abs_dif<T2>(center, min0), abs_dif<T2>(center, max0));
-                ((at + 2) >> 2).stream(dstp0 + x);
-                ((at + 1) >> 1).stream(dstp1 + x);
+                at = max(abs_dif<T2>(center, min0), abs_dif<T2>(center, max0));
             } else if (d->ttype == 3) { // 8 neighbors - not compensated
                 min0 = min(min0, topLeft);
                 max0 = max(max0, topLeft);
@@ -114,9 +116,7 @@ void threshMask_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane,
                 min0 = min(min0, bottomRight);
                 max0 = max(max0, bottomRight);
 
-                const T2 at = max(abs_dif<T2>(center, min0), abs_dif<T2>(center, max0));
-                ((at + 2) >> 2).stream(dstp0 + x);
-                ((at + 1) >> 1).stream(dstp1 + x);
+                at = max(abs_dif<T2>(center, min0), abs_dif<T2>(center, max0));
             } else if (d->ttype == 4) { // 4 neighbors - not compensated (range)
                 min0 = min(min0, top);
                 max0 = max(max0, top);
@@ -129,9 +129,7 @@ void threshMask_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane,
                 min0 = min(min0, bottom);
                 max0 = max(max0, bottom);
 
-                const T2 at = max0 - min0;
-                ((at + 2) >> 2).stream(dstp0 + x);
-                ((at + 1) >> 1).stream(dstp1 + x);
+                at = max0 - min0;
             } else { // 8 neighbors - not compensated (range)
                 min0 = min(min0, topLeft);
                 max0 = max(max0, topLeft);
@@ -152,121 +150,155 @@ void threshMask_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane,
                 min0 = min(min0, bottomRight);
                 max0 = max(max0, bottomRight);
 
-                const T2 at = max0 - min0;
+                at = max0 - min0;
+            }
+
+            if (!fixedQ)
                 ((at + 2) >> 2).stream(dstp0 + x);
+            if (!fixedH)
                 ((at + 1) >> 1).stream(dstp1 + x);
-            }
         }
 
         srcpp = srcp;
         srcp = srcpn;
-        srcpn += (y < height - 2) ? stride : -stride;
-        dstp0 += stride;
-        dstp1 += stride;
+        srcpn += (y < height - 2) ? srcStride : -srcStride;
+        dstp0 += dstStride;
+        dstp1 += dstStride;
     }
+}
 
-    T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0));
-    if (plane == 0 && d->mtqL > -1)
-        std::fill_n(dstp, stride * height, static_cast<T1>(d->mtqL));
-    else if (plane == 0 && d->mthL > -1)
-        std::fill_n(dstp + stride * height, stride * height, static_cast<T1>(d->mthL));
-    else if (plane > 0 && d->mtqC > -1)
-        std::fill_n(dstp, stride * height, static_cast<T1>(d->mtqC));
-    else if (plane > 0 && d->mthC > -1)
-        std::fill_n(dstp + stride * height, stride * height, static_cast<T1>(d->mthC));
+template<typename T1, typename T2, int step>
+void threshMask_sse2(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    const bool fixedQ = (plane ? d->mtqC : d->mtqL) > -1;
+    const bool fixedH = (plane ? d->mthC : d->mthL) > -1;
+
+    if (fixedQ)
+        threshMaskKernel_sse2<T1, T2, step, true, false>(src, dst, plane, d);
+    else if (fixedH)
+        threshMaskKernel_sse2<T1, T2, step, false, true>(src, dst, plane, d);
+    else
+        threshMaskKernel_sse2<T1, T2, step, false, false>(src, dst, plane, d);
 }
 
-template void threshMask_sse2<uint8_t, Vec16uc, 16>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template void threshMask_sse2<uint16_t, Vec8us, 8>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void threshMask_sse2<uint8_t, Vec16uc, 16>(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template void threshMask_sse2<uint16_t, Vec8us, 8>(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
 
-template<typename T1, typename T2, int step>
-void motionMask_sse2(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2, VSFrameRef * dst,
-                     const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
-    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = d->vi.height >> (plane ? d->vi.format->subSamplingH : 0);
-    const int stride = vsapi->getStride(src1, 0) / sizeof(T1);
-    const T1 * srcp1 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src1, 0)) + d->widthPad;
-    const T1 * srcp2 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src2, 0)) + d->widthPad;
-    const T1 * mskp1q = reinterpret_cast<const T1 *>(vsapi->getReadPtr(msk1, 0)) + d->widthPad;
-    const T1 * mskp2q = reinterpret_cast<const T1 *>(vsapi->getReadPtr(msk2, 0)) + d->widthPad;
-    T1 * dstpq = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
-
-    const T1 * mskp1h = mskp1q + stride * height;
-    const T1 * mskp2h = mskp2q + stride * height;
+template<typename T1, typename T2, int step, bool fixedQ, bool fixedH>
+static void motionMaskKernel_sse2(const TDMFrame & src1, const TDMFrame * msk1, const TDMFrame & src2, const TDMFrame * msk2, const TDMFrame & dst,
+                              const int plane, const TDeintModCore * d) noexcept {
+    constexpr T1 peak = std::numeric_limits<T1>::max();
+
+    const int width = src1.width[plane];
+    const int height = src1.height[plane];
+    const int srcStride1 = src1.stride[plane] / sizeof(T1);
+    const int srcStride2 = src2.stride[plane] / sizeof(T1);
+    const int stride = dst.stride[0] / sizeof(T1);
+    const T1 * srcp1 = reinterpret_cast<const T1 *>(src1.ptr[plane]);
+    const T1 * srcp2 = reinterpret_cast<const T1 *>(src2.ptr[plane]);
+    const T1 * mskp1q = (fixedQ && fixedH) ? nullptr : reinterpret_cast<const T1 *>(msk1->ptr[0]);
+    const T1 * mskp2q = (fixedQ && fixedH) ? nullptr : reinterpret_cast<const T1 *>(msk2->ptr[0]);
+    T1 * dstpq = reinterpret_cast<T1 *>(dst.ptr[0]);
+
+    const T1 * mskp1h = fixedH ? nullptr : mskp1q + stride * height;
+    const T1 * mskp2h = fixedH ? nullptr : mskp2q + stride * height;
     T1 * dstph = dstpq + stride * height;
 
+    const T2 fixedThreshq = fixedQ ? std::min(std::max((plane ? d->mtqC : d->mtqL) + d->nt, d->minthresh), d->maxthresh) : 0;
+    const T2 fixedThreshh = fixedH ? std::min(std::max((plane ? d->mthC : d->mthL) + d->nt, d->minthresh), d->maxthresh) : 0;
+
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x += step) {
             const T2 diff = abs_dif<T2>(T2().load_a(srcp1 + x), T2().load_a(srcp2 + x));
-            const T2 minq = min(T2().load_a(mskp1q + x), T2().load_a(mskp2q + x));
-            const T2 minh = min(T2().load_a(mskp1h + x), T2().load_a(mskp2h + x));
-            const T2 threshq = min(max(add_saturated(minq, d->nt), d->minthresh), d->maxthresh);
-            const T2 threshh = min(max(add_saturated(minh, d->nt), d->minthresh), d->maxthresh);
-            select(diff <= threshq, T2(1), zero_128b()).stream(dstpq + x);
-            select(diff <= threshh, T2(1), zero_128b()).stream(dstph + x);
+            const T2 threshq = fixedQ ? fixedThreshq : min(max(add_saturated(min(T2().load_a(mskp1q + x), T2().load_a(mskp2q + x)), d->nt), d->minthresh), d->maxthresh);
+            const T2 threshh = fixedH ? fixedThreshh : min(max(add_saturated(min(T2().load_a(mskp1h + x), T2().load_a(mskp2h + x)), d->nt), d->minthresh), d->maxthresh);
+            select(diff <= threshq, T2(peak), zero_128b()).stream(dstpq + x);
+            select(diff <= threshh, T2(peak), zero_128b()).stream(dstph + x);
         }
 
-        srcp1 += stride;
-        srcp2 += stride;
-        mskp1q += stride;
-        mskp1h += stride;
-        mskp2q += stride;
-        mskp2h += stride;
+        srcp1 += srcStride1;
+        srcp2 += srcStride2;
+        if (!fixedQ) {
+            mskp1q += stride;
+            mskp2q += stride;
+        }
+        if (!fixedH) {
+            mskp1h += stride;
+            mskp2h += stride;
+        }
         dstpq += stride;
         dstph += stride;
     }
 }
 
-template void motionMask_sse2<uint8_t, Vec16uc, 16>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template void motionMask_sse2<uint16_t, Vec8us, 8>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step>
+void motionMask_sse2(const TDMFrame & src1, const TDMFrame * msk1, const TDMFrame & src2, const TDMFrame * msk2, const TDMFrame & dst,
+                     const int plane, const TDeintModCore * d) noexcept {
+    const bool fixedQ = (plane ? d->mtqC : d->mtqL) > -1;
+    const bool fixedH = (plane ? d->mthC : d->mthL) > -1;
+
+    if (fixedQ && fixedH)
+        motionMaskKernel_sse2<T1, T2, step, true, true>(src1, msk1, src2, msk2, dst, plane, d);
+    else if (fixedQ)
+        motionMaskKernel_sse2<T1, T2, step, true, false>(src1, msk1, src2, msk2, dst, plane, d);
+    else if (fixedH)
+        motionMaskKernel_sse2<T1, T2, step, false, true>(src1, msk1, src2, msk2, dst, plane, d);
+    else
+        motionMaskKernel_sse2<T1, T2, step, false, false>(src1, msk1, src2, msk2, dst, plane, d);
+}
+
+template void motionMask_sse2<uint8_t, Vec16uc, 16>(const TDMFrame &, const TDMFrame *, const TDMFrame &, const TDMFrame *, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template void motionMask_sse2<uint16_t, Vec8us, 8>(const TDMFrame &, const TDMFrame *, const TDMFrame &, const TDMFrame *, const TDMFrame &, const int, const TDeintModCore *) noexcept;
 
 template<typename T1, typename T2, int step>
-void andMasks_sse2(const VSFrameRef * src1, const VSFrameRef * src2, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
-    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = (d->vi.height * 2) >> (plane ? d->vi.format->subSamplingH : 0);
-    const int stride = vsapi->getStride(src1, 0) / sizeof(T1);
-    const T1 * srcp1 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src1, 0)) + d->widthPad;
-    const T1 * srcp2 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src2, 0)) + d->widthPad;
-    T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
+void andMasks_sse2(const TDMFrame & src1, const TDMFrame & src2, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    const int width = src1.width[0] >> (plane ? d->subSamplingW : 0);
+    const int height = src1.height[0] >> (plane ? d->subSamplingH : 0);
+    const int stride = src1.stride[0] / sizeof(T1);
+    const T1 * srcp1 = reinterpret_cast<const T1 *>(src1.ptr[0]);
+    const T1 * srcp2 = reinterpret_cast<const T1 *>(src2.ptr[0]);
+    T1 * dstp = reinterpret_cast<T1 *>(dst.ptr[0]);
 
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x += step)
             (T2().load_a(srcp1 + x) & T2().load_a(srcp2 + x) & T2().load_a(dstp + x)).stream(dstp + x);
 
-        dstp[-1] = dstp[1];
-        dstp[width] = dstp[width - 2];
-
         srcp1 += stride;
         srcp2 += stride;
         dstp += stride;
     }
 }
 
-template void andMasks_sse2<uint8_t, Vec16uc, 16>(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template void andMasks_sse2<uint16_t, Vec8us, 8>(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void andMasks_sse2<uint8_t, Vec16uc, 16>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template void andMasks_sse2<uint16_t, Vec8us, 8>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
 
 template<typename T1, typename T2, int step>
-void combineMasks_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+void combineMasks_sse2(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
     constexpr T1 peak = std::numeric_limits<T1>::max();
 
-    const int width = vsapi->getFrameWidth(dst, plane);
-    const int height = vsapi->getFrameHeight(dst, plane);
-    const int srcStride = vsapi->getStride(src, 0) / sizeof(T1);
-    const int dstStride = vsapi->getStride(dst, plane) / sizeof(T1);
-    const T1 * srcp0 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src, 0)) + d->widthPad;
-    T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, plane));
+    const int width = dst.width[plane];
+    const int height = dst.height[plane];
+    const int srcStride = src.stride[0] / sizeof(T1);
+    const int dstStride = dst.stride[plane] / sizeof(T1);
+    const T1 * srcp0 = reinterpret_cast<const T1 *>(src.ptr[0]);
+    T1 * dstp = reinterpret_cast<T1 *>(dst.ptr[plane]);
 
     const T1 * srcpp0 = srcp0 + srcStride;
     const T1 * srcpn0 = srcpp0;
     const T1 * srcp1 = srcp0 + srcStride * height;
 
-    vs_bitblt(dstp, vsapi->getStride(dst, plane), srcp0, vsapi->getStride(src, 0), width * sizeof(T1), height);
+    tdmBitblt(dstp, dst.stride[plane], srcp0, src.stride[0], width * sizeof(T1), height);
 
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x += step) {
-            const T2 count = T2().load(srcpp0 + x - 1) + T2().load_a(srcpp0 + x) + T2().load(srcpp0 + x + 1) +
-                             T2().load(srcp0 + x - 1) + T2().load(srcp0 + x + 1) +
-                             T2().load(srcpn0 + x - 1) + T2().load_a(srcpn0 + x) + T2().load(srcpn0 + x + 1);
+            T2 topLeft, topRight, left, right, bottomLeft, bottomRight;
+            loadNeighbors<T1, T2, step>(srcpp0, x, width, topLeft, topRight);
+            loadNeighbors<T1, T2, step>(srcp0, x, width, left, right);
+            loadNeighbors<T1, T2, step>(srcpn0, x, width, bottomLeft, bottomRight);
+            // The masks hold 0 or peak, so their lowest bits count the set neighbors
+            const T2 one = 1;
+            const T2 count = (topLeft & one) + (T2().load_a(srcpp0 + x) & one) + (topRight & one) +
+                             (left & one) + (right & one) +
+                             (bottomLeft & one) + (T2().load_a(srcpn0 + x) & one) + (bottomRight & one);
             select(T2().load_a(srcp0 + x) == T2(zero_128b()) && T2().load_a(srcp1 + x) != T2(zero_128b()) && count >= d->cstr, peak, T2().load_a(dstp + x)).stream(dstp + x);
         }
 
@@ -278,6 +310,140 @@ void combineMasks_sse2(const VSFrameRef * src, VSFrameRef * dst, const int plane
     }
 }
 
-template void combineMasks_sse2<uint8_t, Vec16uc, 16>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template void combineMasks_sse2<uint16_t, Vec8us, 8>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void combineMasks_sse2<uint8_t, Vec16uc, 16>(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template void combineMasks_sse2<uint16_t, Vec8us, 8>(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+// Lanes twice as wide as the samples, which hold the sums of three absolute differences of the ELA costs
+template<typename T2> struct WideOf;
+template<> struct WideOf<Vec16uc> { typedef Vec8us type; };
+template<> struct WideOf<Vec8us> { typedef Vec4ui type; };
+
+template<typename T2>
+static inline T2 blend(const T2 & mask, const T2 & a, const T2 & b) noexcept {
+    return T2((mask & a) | (~mask & b));
+}
+
+// (a + b + 1) >> 1 without the sum overflowing the lanes
+template<typename T2>
+static inline T2 average(const T2 & a, const T2 & b) noexcept {
+    return T2(T2(a | b) - T2(T2(a ^ b) >> 1));
+}
+
+template<typename T1, typename T2>
+static inline T2 loadPartial(const T1 * p, const int count) noexcept {
+    T2 v;
+    v.load_partial(count, p);
+    return v;
+}
+
+// Edge-directed interpolation of the pixels at a and b, the lines above and below, which must have two readable samples on each side.
+// Matches elaPixel of the generic kernels.
+template<typename T1, typename T2>
+static inline T2 ela_sse2(const T1 * a, const T1 * b) noexcept {
+    typedef typename WideOf<T2>::type W;
+
+    const T2 aLeft2 = T2().load(a - 2), aLeft = T2().load(a - 1), aCenter = T2().load(a), aRight = T2().load(a + 1), aRight2 = T2().load(a + 2);
+    const T2 bLeft2 = T2().load(b - 2), bLeft = T2().load(b - 1), bCenter = T2().load(b), bRight = T2().load(b + 1), bRight2 = T2().load(b + 2);
+
+    const T2 dif[3][3] = {
+        { abs_dif(aLeft, bLeft), abs_dif(aCenter, bCenter), abs_dif(aRight, bRight) },
+        { abs_dif(aLeft2, bCenter), abs_dif(aLeft, bRight), abs_dif(aCenter, bRight2) },
+        { abs_dif(aCenter, bLeft2), abs_dif(aRight, bLeft), abs_dif(aRight2, bCenter) }
+    };
+
+    W left[2], right[2];
+    for (int half = 0; half < 2; half++) {
+        W cost[3];
+        for (int i = 0; i < 3; i++) {
+            cost[i] = half ? extend_high(dif[i][0]) + extend_high(dif[i][1]) + extend_high(dif[i][2])
+                           : extend_low(dif[i][0]) + extend_low(dif[i][1]) + extend_low(dif[i][2]);
+        }
+        left[half] = W(cost[1] < cost[0]);
+        right[half] = W(cost[2] < min(cost[0], cost[1]));
+    }
+
+    T2 result = average(aCenter, bCenter);
+    result = blend(compress(left[0], left[1]), average(aLeft, bRight), result);
+    result = blend(compress(right[0], right[1]), average(aRight, bLeft), result);
+    return min(max(result, min(aCenter, bCenter)), max(aCenter, bCenter));
+}
+
+template<typename T1, typename T2, int step>
+void elaDeint_sse2(const TDMFrame & dst, const TDMFrame & mask, const TDMFrame & prv, const TDMFrame & src, const TDMFrame & nxt,
+                   const TDeintModCore * d) noexcept {
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int prvStride = prv.stride[plane] / sizeof(T1);
+            const int stride = src.stride[plane] / sizeof(T1);
+            const int nxtStride = nxt.stride[plane] / sizeof(T1);
+            const int maskStride = mask.stride[plane] / sizeof(T1);
+            const int dstStride = dst.stride[plane] / sizeof(T1);
+            const T1 * prvp = reinterpret_cast<const T1 *>(prv.ptr[plane]);
+            const T1 * srcp = reinterpret_cast<const T1 *>(src.ptr[plane]);
+            const T1 * nxtp = reinterpret_cast<const T1 *>(nxt.ptr[plane]);
+            const T1 * maskp = reinterpret_cast<const T1 *>(mask.ptr[plane]);
+            T1 * dstp = reinterpret_cast<T1 *>(dst.ptr[plane]);
+
+            const T1 * srcpp = srcp - stride;
+            const T1 * srcpn = srcp + stride;
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x += step) {
+                    // the last vector of a line only reads and writes the pixels inside the line
+                    const int count = std::min(step, width - x);
+                    const T2 maskv = loadPartial<T1, T2>(maskp + x, count);
+                    const T2 prvv = loadPartial<T1, T2>(prvp + x, count);
+                    const T2 srcv = loadPartial<T1, T2>(srcp + x, count);
+                    const T2 nxtv = loadPartial<T1, T2>(nxtp + x, count);
+
+                    // only the vectors with moving pixels are interpolated
+                    const auto moving = maskv == 60;
+                    T2 interpolated = 0;
+                    if (horizontal_or(moving)) {
+                        if (y == 0) {
+                            interpolated = loadPartial<T1, T2>(srcpn + x, count);
+                        } else if (y == height - 1) {
+                            interpolated = loadPartial<T1, T2>(srcpp + x, count);
+                        } else if (x >= 2 && x + step + 2 <= width) {
+                            interpolated = ela_sse2<T1, T2>(srcpp + x, srcpn + x);
+                        } else {
+                            // the outermost samples of the lines are repeated past the edges
+                            T1 a[step + 4], b[step + 4];
+                            for (int i = 0; i < step + 4; i++) {
+                                const int pos = std::min(std::max(x + i - 2, 0), width - 1);
+                                a[i] = srcpp[pos];
+                                b[i] = srcpn[pos];
+                            }
+                            interpolated = ela_sse2<T1, T2>(a + 2, b + 2);
+                        }
+                    }
+
+                    // (prv + src * 2 + nxt + 2) >> 2 equals the rounded average of src and the truncated average of prv and nxt
+                    T2 result = loadPartial<T1, T2>(dstp + x, count);
+                    result = blend(T2(maskv == 10), srcv, result);
+                    result = blend(T2(maskv == 20), prvv, result);
+                    result = blend(T2(maskv == 30), nxtv, result);
+                    result = blend(T2(maskv == 40), average(srcv, nxtv), result);
+                    result = blend(T2(maskv == 50), average(srcv, prvv), result);
+                    result = blend(T2(maskv == 70), average(srcv, T2(T2(prvv & nxtv) + T2(T2(prvv ^ nxtv) >> 1))), result);
+                    result = blend(T2(moving), interpolated, result);
+                    result.store_partial(count, dstp + x);
+                }
+
+                prvp += prvStride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                nxtp += nxtStride;
+                maskp += maskStride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+template void elaDeint_sse2<uint8_t, Vec16uc, 16>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+template void elaDeint_sse2<uint16_t, Vec8us, 8>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
 #endif
@@ -0,0 +1,712 @@
+#include "TDeintModCore.hpp"
+
+#ifdef TDM_VECTOR_EXTENSIONS
+#include <cstring>
+
+// 128-bit vectors, which the compiler maps onto SSE2 on x86 and NEON on ARM. The wide types hold the same lanes as 32-bit integers.
+template<typename T> struct VectorOf;
+
+template<> struct VectorOf<uint8_t> {
+    typedef uint8_t type __attribute__((vector_size(16)));
+    typedef int32_t wide __attribute__((vector_size(64)));
+};
+
+template<> struct VectorOf<uint16_t> {
+    typedef uint16_t type __attribute__((vector_size(16)));
+    typedef int32_t wide __attribute__((vector_size(32)));
+};
+
+template<typename T> using Vec = typename VectorOf<T>::type;
+template<typename T> using WideVec = typename VectorOf<T>::wide;
+
+template<typename T>
+static inline Vec<T> splat(const int x) noexcept {
+    return Vec<T>{} + static_cast<T>(x);
+}
+
+// Loads count samples, at most a whole vector, and zeroes the remaining lanes
+template<typename T>
+static inline Vec<T> load(const T * p, const int count = sizeof(Vec<T>) / sizeof(T)) noexcept {
+    Vec<T> v{};
+    if (count == sizeof(Vec<T>) / sizeof(T))
+        memcpy(&v, p, sizeof(v));
+    else
+        memcpy(&v, p, count * sizeof(T));
+    return v;
+}
+
+template<typename T>
+static inline void store(T * p, const Vec<T> & v, const int count) noexcept {
+    if (count == sizeof(Vec<T>) / sizeof(T))
+        memcpy(p, &v, sizeof(v));
+    else
+        memcpy(p, &v, count * sizeof(T));
+}
+
+// Comparisons yield vectors of signed lanes with all bits set where true, which are reinterpreted as masks of the sample type
+template<typename V>
+static inline V select(const V & mask, const V & a, const V & b) noexcept {
+    return (mask & a) | (~mask & b);
+}
+
+template<typename V>
+static inline V vmin(const V & a, const V & b) noexcept {
+    return select(static_cast<V>(a < b), a, b);
+}
+
+template<typename V>
+static inline V vmax(const V & a, const V & b) noexcept {
+    return select(static_cast<V>(a > b), a, b);
+}
+
+template<typename V>
+static inline V absDif(const V & a, const V & b) noexcept {
+    return vmax(a, b) - vmin(a, b);
+}
+
+template<typename V>
+static inline V nonZero(const V & a) noexcept {
+    return static_cast<V>(a != 0);
+}
+
+// (a + half) >> shift as computed with ints, without the sum overflowing the lanes
+template<typename T>
+static inline Vec<T> roundShift(const Vec<T> & a, const int half, const int shift) noexcept {
+    return (a >> shift) + (((a & static_cast<T>((1 << shift) - 1)) + static_cast<T>(half)) >> shift);
+}
+
+// (a + b + 1) >> 1 without the sum overflowing the lanes
+template<typename V>
+static inline V average(const V & a, const V & b) noexcept {
+    return (a | b) - ((a ^ b) >> 1);
+}
+
+// Loads the horizontal neighbors of srcp[x .. x + step - 1], mirroring them at the left and right edges of the row
+template<typename T>
+static inline void loadNeighbors(const T * srcp, const int x, const int width, Vec<T> & left, Vec<T> & right) noexcept {
+    constexpr int step = sizeof(Vec<T>) / sizeof(T);
+
+    if (x > 0 && x + step < width) {
+        left = load(srcp + x - 1);
+        right = load(srcp + x + 1);
+    } else {
+        const int count = std::min(step, width - x);
+        T temp[step + 2] = {};
+        std::copy_n(srcp + x, count, temp + 1);
+        temp[0] = srcp[x ? x - 1 : 1];
+        temp[count + 1] = (x + step < width) ? srcp[x + step] : srcp[width - 2];
+        left = load(temp);
+        right = load(temp + 2);
+    }
+}
+
+template<typename T, bool fixedQ, bool fixedH>
+static void threshMaskKernel_vector(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    using V = Vec<T>;
+    constexpr int step = sizeof(V) / sizeof(T);
+
+    const int width = src.width[plane];
+    const int height = src.height[plane];
+    const int srcStride = src.stride[plane] / sizeof(T);
+    const int dstStride = dst.stride[0] / sizeof(T);
+    const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+    T * dstp0 = reinterpret_cast<T *>(dst.ptr[0]);
+    T * dstp1 = dstp0 + dstStride * height;
+
+    const T * srcpp = srcp + srcStride;
+    const T * srcpn = srcpp;
+
+    const bool eight = d->ttype & 1;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += step) {
+            const int count = std::min(step, width - x);
+            V topLeft, topRight, left, right, bottomLeft, bottomRight;
+            loadNeighbors(srcpp, x, width, topLeft, topRight);
+            loadNeighbors(srcp, x, width, left, right);
+            loadNeighbors(srcpn, x, width, bottomLeft, bottomRight);
+            const V top = load(srcpp + x, count);
+            const V center = load(srcp + x, count);
+            const V bottom = load(srcpn + x, count);
+
+            V min0 = vmin(top, bottom), max0 = vmax(top, bottom);
+            if (eight) {
+                min0 = vmin(vmin(min0, topLeft), vmin(topRight, vmin(bottomLeft, bottomRight)));
+                max0 = vmax(vmax(max0, topLeft), vmax(topRight, vmax(bottomLeft, bottomRight)));
+            }
+
+            V at;
+            if (d->ttype < 2) { // compensated
+                const V min1 = vmin(left, right), max1 = vmax(left, right);
+                const V atv = vmax(roundShift<T>(absDif(center, min0), d->vHalf[plane], d->vShift[plane]),
+                                   roundShift<T>(absDif(center, max0), d->vHalf[plane], d->vShift[plane]));
+                const V ath = vmax(roundShift<T>(absDif(center, min1), d->hHalf[plane], d->hShift[plane]),
+                                   roundShift<T>(absDif(center, max1), d->hHalf[plane], d->hShift[plane]));
+                at = vmax(atv, ath);
+            } else {
+                min0 = vmin(min0, vmin(left, right));
+                max0 = vmax(max0, vmax(left, right));
+                if (d->ttype < 4) // not compensated
+                    at = vmax(absDif(center, min0), absDif(center, max0));
+                else // not compensated (range)
+                    at = vmax(max0, center) - vmin(min0, center);
+            }
+
+            if (!fixedQ)
+                store(dstp0 + x, roundShift<T>(at, 2, 2), count);
+            if (!fixedH)
+                store(dstp1 + x, roundShift<T>(at, 1, 1), count);
+        }
+
+        srcpp = srcp;
+        srcp = srcpn;
+        srcpn += (y < height - 2) ? srcStride : -srcStride;
+        dstp0 += dstStride;
+        dstp1 += dstStride;
+    }
+}
+
+template<typename T>
+void threshMask_vector(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    const bool fixedQ = (plane ? d->mtqC : d->mtqL) > -1;
+    const bool fixedH = (plane ? d->mthC : d->mthL) > -1;
+
+    if (fixedQ)
+        threshMaskKernel_vector<T, true, false>(src, dst, plane, d);
+    else if (fixedH)
+        threshMaskKernel_vector<T, false, true>(src, dst, plane, d);
+    else
+        threshMaskKernel_vector<T, false, false>(src, dst, plane, d);
+}
+
+template void threshMask_vector<uint8_t>(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template void threshMask_vector<uint16_t>(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+template<typename T, bool fixedQ, bool fixedH>
+static void motionMaskKernel_vector(const TDMFrame & src1, const TDMFrame * msk1, const TDMFrame & src2, const TDMFrame * msk2, const TDMFrame & dst,
+                                    const int plane, const TDeintModCore * d) noexcept {
+    using V = Vec<T>;
+    constexpr int step = sizeof(V) / sizeof(T);
+    constexpr T peak = std::numeric_limits<T>::max();
+
+    const int width = src1.width[plane];
+    const int height = src1.height[plane];
+    const int srcStride1 = src1.stride[plane] / sizeof(T);
+    const int srcStride2 = src2.stride[plane] / sizeof(T);
+    const int stride = dst.stride[0] / sizeof(T);
+    const T * srcp1 = reinterpret_cast<const T *>(src1.ptr[plane]);
+    const T * srcp2 = reinterpret_cast<const T *>(src2.ptr[plane]);
+    const T * mskp1q = (fixedQ && fixedH) ? nullptr : reinterpret_cast<const T *>(msk1->ptr[0]);
+    const T * mskp2q = (fixedQ && fixedH) ? nullptr : reinterpret_cast<const T *>(msk2->ptr[0]);
+    T * dstpq = reinterpret_cast<T *>(dst.ptr[0]);
+
+    const T * mskp1h = fixedH ? nullptr : mskp1q + stride * height;
+    const T * mskp2h = fixedH ? nullptr : mskp2q + stride * height;
+    T * dstph = dstpq + stride * height;
+
+    const V fixedThreshq = splat<T>(fixedQ ? std::min(std::max((plane ? d->mtqC : d->mtqL) + d->nt, d->minthresh), d->maxthresh) : 0);
+    const V fixedThreshh = splat<T>(fixedH ? std::min(std::max((plane ? d->mthC : d->mthL) + d->nt, d->minthresh), d->maxthresh) : 0);
+    const V nt = splat<T>(d->nt), minthresh = splat<T>(d->minthresh), maxthresh = splat<T>(d->maxthresh);
+
+    // min(max(min(a, b) + nt, minthresh), maxthresh) with the addition saturating at peak
+    const auto adaptiveThresh = [&](const V & a, const V & b) noexcept {
+        const V m = vmin(a, b);
+        const V sum = m + nt;
+        return vmin(vmax(select(static_cast<V>(sum < m), splat<T>(peak), sum), minthresh), maxthresh);
+    };
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += step) {
+            const int count = std::min(step, width - x);
+            const V diff = absDif(load(srcp1 + x, count), load(srcp2 + x, count));
+            const V threshq = fixedQ ? fixedThreshq : adaptiveThresh(load(mskp1q + x, count), load(mskp2q + x, count));
+            const V threshh = fixedH ? fixedThreshh : adaptiveThresh(load(mskp1h + x, count), load(mskp2h + x, count));
+            store(dstpq + x, static_cast<V>(diff <= threshq), count);
+            store(dstph + x, static_cast<V>(diff <= threshh), count);
+        }
+
+        srcp1 += srcStride1;
+        srcp2 += srcStride2;
+        if (!fixedQ) {
+            mskp1q += stride;
+            mskp2q += stride;
+        }
+        if (!fixedH) {
+            mskp1h += stride;
+            mskp2h += stride;
+        }
+        dstpq += stride;
+        dstph += stride;
+    }
+}
+
+template<typename T>
+void motionMask_vector(const TDMFrame & src1, const TDMFrame * msk1, const TDMFrame & src2, const TDMFrame * msk2, const TDMFrame & dst,
+                       const int plane, const TDeintModCore * d) noexcept {
+    const bool fixedQ = (plane ? d->mtqC : d->mtqL) > -1;
+    const bool fixedH = (plane ? d->mthC : d->mthL) > -1;
+
+    if (fixedQ && fixedH)
+        motionMaskKernel_vector<T, true, true>(src1, msk1, src2, msk2, dst, plane, d);
+    else if (fixedQ)
+        motionMaskKernel_vector<T, true, false>(src1, msk1, src2, msk2, dst, plane, d);
+    else if (fixedH)
+        motionMaskKernel_vector<T, false, true>(src1, msk1, src2, msk2, dst, plane, d);
+    else
+        motionMaskKernel_vector<T, false, false>(src1, msk1, src2, msk2, dst, plane, d);
+}
+
+template void motionMask_vector<uint8_t>(const TDMFrame &, const TDMFrame *, const TDMFrame &, const TDMFrame *, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template void motionMask_vector<uint16_t>(const TDMFrame &, const TDMFrame *, const TDMFrame &, const TDMFrame *, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+template<typename T>
+void andMasks_vector(const TDMFrame & src1, const TDMFrame & src2, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    constexpr int step = sizeof(Vec<T>) / sizeof(T);
+
+    const int width = src1.width[0] >> (plane ? d->subSamplingW : 0);
+    const int height = src1.height[0] >> (plane ? d->subSamplingH : 0);
+    const int stride = src1.stride[0] / sizeof(T);
+    const T * srcp1 = reinterpret_cast<const T *>(src1.ptr[0]);
+    const T * srcp2 = reinterpret_cast<const T *>(src2.ptr[0]);
+    T * dstp = reinterpret_cast<T *>(dst.ptr[0]);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += step) {
+            const int count = std::min(step, width - x);
+            store(dstp + x, load(srcp1 + x, count) & load(srcp2 + x, count) & load(dstp + x, count), count);
+        }
+
+        srcp1 += stride;
+        srcp2 += stride;
+        dstp += stride;
+    }
+}
+
+template void andMasks_vector<uint8_t>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template void andMasks_vector<uint16_t>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+template<typename T>
+void combineMasks_vector(const TDMFrame & src, const TDMFrame & dst, const int plane, const TDeintModCore * d) noexcept {
+    using V = Vec<T>;
+    constexpr int step = sizeof(V) / sizeof(T);
+    constexpr T peak = std::numeric_limits<T>::max();
+
+    const int width = dst.width[plane];
+    const int height = dst.height[plane];
+    const int srcStride = src.stride[0] / sizeof(T);
+    const int dstStride = dst.stride[plane] / sizeof(T);
+    const T * srcp0 = reinterpret_cast<const T *>(src.ptr[0]);
+    T * dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+    const T * srcpp0 = srcp0 + srcStride;
+    const T * srcpn0 = srcpp0;
+    const T * srcp1 = srcp0 + srcStride * height;
+
+    const V cstr = splat<T>(d->cstr);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += step) {
+            const int count = std::min(step, width - x);
+            V topLeft, topRight, left, right, bottomLeft, bottomRight;
+            loadNeighbors(srcpp0, x, width, topLeft, topRight);
+            loadNeighbors(srcp0, x, width, left, right);
+            loadNeighbors(srcpn0, x, width, bottomLeft, bottomRight);
+            const V center = load(srcp0 + x, count);
+
+            // Every set neighbor subtracts one from the all-zero vector, so negating the sum of the masks counts them
+            const V count8 = -(nonZero(topLeft) + nonZero(load(srcpp0 + x, count)) + nonZero(topRight) +
+                               nonZero(left) + nonZero(right) +
+                               nonZero(bottomLeft) + nonZero(load(srcpn0 + x, count)) + nonZero(bottomRight));
+            const V fill = ~nonZero(center) & nonZero(load(srcp1 + x, count)) & static_cast<V>(count8 >= cstr);
+            store(dstp + x, select(fill, splat<T>(peak), center), count);
+        }
+
+        srcpp0 = srcp0;
+        srcp0 = srcpn0;
+        srcpn0 += (y < height - 2) ? srcStride : -srcStride;
+        srcp1 += srcStride;
+        dstp += dstStride;
+    }
+}
+
+template void combineMasks_vector<uint8_t>(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+template void combineMasks_vector<uint16_t>(const TDMFrame &, const TDMFrame &, const int, const TDeintModCore *) noexcept;
+
+// The static period tests of the C version run for a vector of pixels at once. The early exit once the mask value can no longer
+// change is dropped, as every vlut entry that stops the search only leads to entries with the same result.
+template<typename T, int fixedLength>
+static void buildMaskKernel_vector(const TDMFrame * cSrc, const TDMFrame * oSrc, const TDMFrame & dst, const int cCount, const int oCount, const int order,
+                                   const int field, int * summary, double * movingRatio, const TDeintModCore * d) noexcept {
+    using V = Vec<T>;
+    constexpr int step = sizeof(V) / sizeof(T);
+
+    const int length = fixedLength ? fixedLength : d->length;
+
+    const uint8_t * tmmlut = d->tmmlut16.data() + order * 8 + field * 4;
+    uint8_t tmmlutf[64];
+    for (int i = 0; i < 64; i++)
+        tmmlutf[i] = tmmlut[d->vlut[i]];
+
+    V plutFixed[2][fixedLength ? 2 * fixedLength - 1 : 1];
+    V * plut[2];
+    for (int i = 0; i < 2; i++)
+        plut[i] = fixedLength ? plutFixed[i] : new V[2 * length - 1];
+
+    const T ** ptlut[3];
+    for (int i = 0; i < 3; i++)
+        ptlut[i] = new const T *[i & 1 ? cCount : oCount];
+
+    const int offo = (length & 1) ? 0 : 1;
+    const int offc = (length & 1) ? 1 : 0;
+    const int ct = cCount / 2;
+    const int run = length - 4;
+
+    bool allStatic = true, allMoving = true;
+    std::fill_n(movingRatio, 3, 0.);
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (tdmAnalyzed(d, plane)) {
+            int64_t moving = 0;
+
+            const int width = dst.width[plane];
+            const int height = dst.height[plane];
+            const int stride = dst.stride[plane] / sizeof(T);
+            const int srcStride = cSrc[0].stride[plane] / sizeof(T);
+            for (int i = 0; i < cCount; i++)
+                ptlut[1][i] = reinterpret_cast<const T *>(cSrc[i].ptr[plane]);
+            for (int i = 0; i < oCount; i++) {
+                if (field == 1) {
+                    ptlut[0][i] = reinterpret_cast<const T *>(oSrc[i].ptr[plane]);
+                    ptlut[2][i] = ptlut[0][i] + srcStride;
+                } else {
+                    ptlut[0][i] = ptlut[2][i] = reinterpret_cast<const T *>(oSrc[i].ptr[plane]);
+                }
+            }
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            if (field == 1) {
+                for (int j = 0; j < height; j += 2)
+                    std::fill_n(dstp + stride * j, width, static_cast<T>(10));
+                dstp += stride;
+            } else {
+                for (int j = 1; j < height; j += 2)
+                    std::fill_n(dstp + stride * j, width, static_cast<T>(10));
+            }
+
+            for (int y = field; y < height; y += 2) {
+                for (int x = 0; x < width; x += step) {
+                    const int count = std::min(step, width - x);
+
+                    for (int j = 0; j < cCount; j++)
+                        plut[0][j * 2 + offc] = plut[1][j * 2 + offc] = nonZero(load(ptlut[1][j] + x, count));
+                    for (int j = 0; j < oCount; j++) {
+                        plut[0][j * 2 + offo] = nonZero(load(ptlut[0][j] + x, count));
+                        plut[1][j * 2 + offo] = nonZero(load(ptlut[2][j] + x, count));
+                    }
+
+                    // Lanes whose current field moves around the center are interpolated without looking for a static period
+                    const V moved = ~(plut[0][(ct - 2) * 2 + offc] | plut[0][ct * 2 + offc] | plut[0][(ct + 1) * 2 + offc]);
+
+                    V val{};
+                    for (int i = 0; i < length; i++) {
+                        const T gv = (i == 0) ? 1 : (i == length - 1 ? 4 : 2);
+                        V static0 = plut[0][i], static1 = plut[1][i];
+                        for (int j = 1; j < run; j++) {
+                            static0 &= plut[0][i + j];
+                            static1 &= plut[1][i + j];
+                        }
+                        val |= (static0 & static_cast<T>(gv * 8)) | (static1 & gv);
+                    }
+
+                    T vals[step], movedLanes[step];
+                    memcpy(vals, &val, sizeof(val));
+                    memcpy(movedLanes, &moved, sizeof(moved));
+                    for (int i = 0; i < count; i++) {
+                        const T value = movedLanes[i] ? 60 : tmmlutf[vals[i]];
+                        dstp[x + i] = value;
+                        allStatic &= (value == 10);
+                        allMoving &= (value == 60);
+                        moving += (value == 60);
+                    }
+                }
+
+                for (int i = 0; i < cCount; i++)
+                    ptlut[1][i] += srcStride;
+                for (int i = 0; i < oCount; i++) {
+                    if (y != 0)
+                        ptlut[0][i] += srcStride;
+                    if (y != height - 3)
+                        ptlut[2][i] += srcStride;
+                }
+                dstp += stride * 2;
+            }
+
+            movingRatio[plane] = static_cast<double>(moving) / (width * ((height + 1 - field) / 2));
+        }
+    }
+
+    if (!fixedLength) {
+        for (int i = 0; i < 2; i++)
+            delete[] plut[i];
+    }
+    for (int i = 0; i < 3; i++)
+        delete[] ptlut[i];
+
+    *summary = allStatic ? maskAllStatic : (allMoving ? maskAllMoving : maskMixed);
+}
+
+template<typename T>
+void buildMask_vector(const TDMFrame * cSrc, const TDMFrame * oSrc, const TDMFrame & dst, const int cCount, const int oCount, const int order, const int field,
+                      int * summary, double * movingRatio, const TDeintModCore * d) noexcept {
+    switch (d->length) {
+    case 6: buildMaskKernel_vector<T, 6>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 7: buildMaskKernel_vector<T, 7>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 8: buildMaskKernel_vector<T, 8>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 9: buildMaskKernel_vector<T, 9>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 10: buildMaskKernel_vector<T, 10>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 11: buildMaskKernel_vector<T, 11>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 12: buildMaskKernel_vector<T, 12>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 13: buildMaskKernel_vector<T, 13>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 14: buildMaskKernel_vector<T, 14>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 15: buildMaskKernel_vector<T, 15>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    case 16: buildMaskKernel_vector<T, 16>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d); break;
+    default: buildMaskKernel_vector<T, 0>(cSrc, oSrc, dst, cCount, oCount, order, field, summary, movingRatio, d);
+    }
+}
+
+template void buildMask_vector<uint8_t>(const TDMFrame *, const TDMFrame *, const TDMFrame &, const int, const int, const int, const int, int *, double *,
+                                        const TDeintModCore *) noexcept;
+template void buildMask_vector<uint16_t>(const TDMFrame *, const TDMFrame *, const TDMFrame &, const int, const int, const int, const int, int *, double *,
+                                         const TDeintModCore *) noexcept;
+
+// The mask values other than 60 pick or average the temporal neighbors. interpolated supplies the pixels for 60.
+template<typename T>
+static inline Vec<T> compose(const Vec<T> & mask, const Vec<T> & prv, const Vec<T> & src, const Vec<T> & nxt, const Vec<T> & interpolated,
+                             const Vec<T> & old) noexcept {
+    using V = Vec<T>;
+
+    V result = old;
+    result = select(static_cast<V>(mask == 10), src, result);
+    result = select(static_cast<V>(mask == 20), prv, result);
+    result = select(static_cast<V>(mask == 30), nxt, result);
+    result = select(static_cast<V>(mask == 40), average(src, nxt), result);
+    result = select(static_cast<V>(mask == 50), average(src, prv), result);
+    // (prv + src * 2 + nxt + 2) >> 2 equals the rounded average of src and the truncated average of prv and nxt
+    result = select(static_cast<V>(mask == 70), average(src, (prv & nxt) + ((prv ^ nxt) >> 1)), result);
+    result = select(static_cast<V>(mask == 60), interpolated, result);
+    return result;
+}
+
+template<typename T>
+void eDeint_vector(const TDMFrame & dst, const TDMFrame & mask, const TDMFrame & prv, const TDMFrame & src, const TDMFrame & nxt, const TDMFrame & edeint,
+                   const TDeintModCore * d) noexcept {
+    constexpr int step = sizeof(Vec<T>) / sizeof(T);
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int prvStride = prv.stride[plane] / sizeof(T);
+            const int srcStride = src.stride[plane] / sizeof(T);
+            const int nxtStride = nxt.stride[plane] / sizeof(T);
+            const int maskStride = mask.stride[plane] / sizeof(T);
+            const int edeintStride = edeint.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * prvp = reinterpret_cast<const T *>(prv.ptr[plane]);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            const T * nxtp = reinterpret_cast<const T *>(nxt.ptr[plane]);
+            const T * maskp = reinterpret_cast<const T *>(mask.ptr[plane]);
+            const T * edeintp = reinterpret_cast<const T *>(edeint.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x += step) {
+                    const int count = std::min(step, width - x);
+                    store(dstp + x, compose<T>(load(maskp + x, count), load(prvp + x, count), load(srcp + x, count), load(nxtp + x, count),
+                                               load(edeintp + x, count), load(dstp + x, count)), count);
+                }
+
+                prvp += prvStride;
+                srcp += srcStride;
+                nxtp += nxtStride;
+                maskp += maskStride;
+                edeintp += edeintStride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+template void eDeint_vector<uint8_t>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &,
+                                     const TDeintModCore *) noexcept;
+template void eDeint_vector<uint16_t>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &,
+                                      const TDeintModCore *) noexcept;
+
+template<typename T>
+void cubicDeint_vector(const TDMFrame & dst, const TDMFrame & mask, const TDMFrame & prv, const TDMFrame & src, const TDMFrame & nxt,
+                       const TDeintModCore * d) noexcept {
+    using V = Vec<T>;
+    using W = WideVec<T>;
+    constexpr int step = sizeof(V) / sizeof(T);
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int prvStride = prv.stride[plane] / sizeof(T);
+            const int stride = src.stride[plane] / sizeof(T);
+            const int nxtStride = nxt.stride[plane] / sizeof(T);
+            const int maskStride = mask.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * prvp = reinterpret_cast<const T *>(prv.ptr[plane]);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            const T * nxtp = reinterpret_cast<const T *>(nxt.ptr[plane]);
+            const T * maskp = reinterpret_cast<const T *>(mask.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            const T * srcpp = srcp - stride;
+            const T * srcppp = srcpp - stride * 2;
+            const T * srcpn = srcp + stride;
+            const T * srcpnn = srcpn + stride * 2;
+
+            const W peak = W{} + d->peak;
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x += step) {
+                    const int count = std::min(step, width - x);
+
+                    // Only the lines the interpolation of the row needs are read, the others may lie outside the plane
+                    V interpolated;
+                    if (y == 0) {
+                        interpolated = load(srcpn + x, count);
+                    } else if (y == height - 1) {
+                        interpolated = load(srcpp + x, count);
+                    } else if (y < 3 || y > height - 4) {
+                        interpolated = average(load(srcpn + x, count), load(srcpp + x, count));
+                    } else {
+                        const W pp = __builtin_convertvector(load(srcpp + x, count), W);
+                        const W pn = __builtin_convertvector(load(srcpn + x, count), W);
+                        const W ppp = __builtin_convertvector(load(srcppp + x, count), W);
+                        const W pnn = __builtin_convertvector(load(srcpnn + x, count), W);
+                        W temp = (19 * (pp + pn) - 3 * (ppp + pnn) + 16) >> 5;
+                        temp &= ~(temp < 0);
+                        const W over = temp > peak;
+                        interpolated = __builtin_convertvector((temp & ~over) | (peak & over), V);
+                    }
+
+                    store(dstp + x, compose<T>(load(maskp + x, count), load(prvp + x, count), load(srcp + x, count), load(nxtp + x, count),
+                                               interpolated, load(dstp + x, count)), count);
+                }
+
+                prvp += prvStride;
+                srcppp += stride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                srcpnn += stride;
+                nxtp += nxtStride;
+                maskp += maskStride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+template void cubicDeint_vector<uint8_t>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+template void cubicDeint_vector<uint16_t>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+
+// Edge-directed interpolation of the pixels at a and b, the lines above and below, which must have two readable samples on each side.
+// Matches elaPixel of the generic kernels.
+template<typename T>
+static inline Vec<T> ela(const T * a, const T * b) noexcept {
+    using V = Vec<T>;
+    using W = WideVec<T>;
+
+    const V aLeft2 = load(a - 2), aLeft = load(a - 1), aCenter = load(a), aRight = load(a + 1), aRight2 = load(a + 2);
+    const V bLeft2 = load(b - 2), bLeft = load(b - 1), bCenter = load(b), bRight = load(b + 1), bRight2 = load(b + 2);
+
+    const W cost = __builtin_convertvector(absDif(aLeft, bLeft), W) + __builtin_convertvector(absDif(aCenter, bCenter), W) +
+                   __builtin_convertvector(absDif(aRight, bRight), W);
+    const W costLeft = __builtin_convertvector(absDif(aLeft2, bCenter), W) + __builtin_convertvector(absDif(aLeft, bRight), W) +
+                       __builtin_convertvector(absDif(aCenter, bRight2), W);
+    const W costRight = __builtin_convertvector(absDif(aCenter, bLeft2), W) + __builtin_convertvector(absDif(aRight, bLeft), W) +
+                        __builtin_convertvector(absDif(aRight2, bCenter), W);
+    const W left = costLeft < cost;
+    const W right = costRight < ((costLeft & left) | (cost & ~left));
+
+    V result = average(aCenter, bCenter);
+    result = select(__builtin_convertvector(left, V), average(aLeft, bRight), result);
+    result = select(__builtin_convertvector(right, V), average(aRight, bLeft), result);
+    return vmin(vmax(result, vmin(aCenter, bCenter)), vmax(aCenter, bCenter));
+}
+
+template<typename T>
+void elaDeint_vector(const TDMFrame & dst, const TDMFrame & mask, const TDMFrame & prv, const TDMFrame & src, const TDMFrame & nxt,
+                     const TDeintModCore * d) noexcept {
+    using V = Vec<T>;
+    constexpr int step = sizeof(V) / sizeof(T);
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = src.width[plane];
+            const int height = src.height[plane];
+            const int prvStride = prv.stride[plane] / sizeof(T);
+            const int stride = src.stride[plane] / sizeof(T);
+            const int nxtStride = nxt.stride[plane] / sizeof(T);
+            const int maskStride = mask.stride[plane] / sizeof(T);
+            const int dstStride = dst.stride[plane] / sizeof(T);
+            const T * prvp = reinterpret_cast<const T *>(prv.ptr[plane]);
+            const T * srcp = reinterpret_cast<const T *>(src.ptr[plane]);
+            const T * nxtp = reinterpret_cast<const T *>(nxt.ptr[plane]);
+            const T * maskp = reinterpret_cast<const T *>(mask.ptr[plane]);
+            T * TDM_RESTRICT dstp = reinterpret_cast<T *>(dst.ptr[plane]);
+
+            const T * srcpp = srcp - stride;
+            const T * srcpn = srcp + stride;
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x += step) {
+                    const int count = std::min(step, width - x);
+                    const V maskv = load(maskp + x, count);
+
+                    // Only the vectors with moving pixels are interpolated, so the cost follows the moving area
+                    const V moving = static_cast<V>(maskv == 60);
+                    V interpolated{};
+                    if (memcmp(&moving, &interpolated, sizeof(V))) {
+                        if (y == 0) {
+                            interpolated = load(srcpn + x, count);
+                        } else if (y == height - 1) {
+                            interpolated = load(srcpp + x, count);
+                        } else if (x >= 2 && x + step + 2 <= width) {
+                            interpolated = ela(srcpp + x, srcpn + x);
+                        } else {
+                            // the outermost samples of the lines are repeated past the edges
+                            T a[step + 4], b[step + 4];
+                            for (int i = 0; i < step + 4; i++) {
+                                const int pos = std::min(std::max(x + i - 2, 0), width - 1);
+                                a[i] = srcpp[pos];
+                                b[i] = srcpn[pos];
+                            }
+                            interpolated = ela(a + 2, b + 2);
+                        }
+                    }
+
+                    store(dstp + x, compose<T>(maskv, load(prvp + x, count), load(srcp + x, count), load(nxtp + x, count), interpolated,
+                                               load(dstp + x, count)), count);
+                }
+
+                prvp += prvStride;
+                srcpp += stride;
+                srcp += stride;
+                srcpn += stride;
+                nxtp += nxtStride;
+                maskp += maskStride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+template void elaDeint_vector<uint8_t>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+template void elaDeint_vector<uint16_t>(const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDMFrame &, const TDeintModCore *) noexcept;
+#endif
@@ -0,0 +1,640 @@
+// tdm: runs TDeintMod over a YUV4MPEG2 stream from stdin and writes the result to stdout, without VapourSynth.
+//
+// A reader thread fills a window of source frames, a pool of workers deinterlaces them and the main thread writes the frames
+// out in order. The workers share one processor, so each motion mask is computed once by whichever worker needs it first. The window
+// only spans the frames the workers still need, so memory stays bounded however long the stream is.
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "TDeintModCore.hpp"
+
+static const char usage[] =
+    "usage: tdm [name=value ...] < input.y4m > output.y4m\n"
+    "\n"
+    "Deinterlaces a YUV4MPEG2 stream with TDeintMod. The parameters are those of tdm.TDeintMod:\n"
+    "  order field mode length lookahead mtype ttype mtql mthl mtqc mthc nt minthresh maxthresh\n"
+    "  cstr lumamask reduce mres athresh metric expand link show type opt, planes and crop (comma separated),\n"
+    "  plus threads\n"
+    "\n"
+    "order defaults to the field order of the stream header. crop gives the borders left out of the processing as\n"
+    "left,right,top,bottom, which are copied from the source. edeint, emask, masks, stats, trace and scenechange are\n"
+    "not available, so the internal interpolation selected by type is used. threads sets the number of workers, 0 uses\n"
+    "one per core.\n";
+
+// Used as the number of frames until the end of the stream is reached
+static constexpr int unknownLength = INT_MAX / 4;
+
+// Source frames shared by the workers. The reader stays a few frames ahead of the furthest frame requested, and frames are dropped
+// once no worker needs them any more.
+class SourceWindow {
+public:
+    explicit SourceWindow(const int ahead) noexcept : readAhead(ahead) {}
+
+    // Called by the reader. Returns false once aborted.
+    bool push(std::shared_ptr<TDMBuffer> frame) {
+        std::unique_lock<std::mutex> lock{ mutex };
+        canRead.wait(lock, [&] { return aborted || end <= wanted + readAhead; });
+        if (aborted)
+            return false;
+        frames.push_back(std::move(frame));
+        end++;
+        ready.notify_all();
+        return true;
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        ended = true;
+        ready.notify_all();
+    }
+
+    // Blocks until frame n has been read. Returns false if the stream ends before it.
+    bool wait(const int n) {
+        std::unique_lock<std::mutex> lock{ mutex };
+        if (n > wanted) {
+            wanted = n;
+            canRead.notify_all();
+        }
+        ready.wait(lock, [&] { return aborted || ended || n < end; });
+        if (aborted)
+            throw std::string{ "aborted" };
+        return n < end;
+    }
+
+    std::shared_ptr<TDMBuffer> get(const int n) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        if (n < start || n >= end)
+            throw std::string{ "frame " + std::to_string(n) + " is no longer buffered" };
+        return frames[n - start];
+    }
+
+    int length() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        return end;
+    }
+
+    // No worker will request frames before n any more
+    void release(const int n) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        while (start < n && !frames.empty()) {
+            frames.pop_front();
+            start++;
+        }
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        aborted = true;
+        ready.notify_all();
+        canRead.notify_all();
+    }
+
+private:
+    std::deque<std::shared_ptr<TDMBuffer>> frames;
+    const int readAhead;
+    int start = 0, end = 0, wanted = 0;
+    bool ended = false, aborted = false;
+    std::mutex mutex;
+    std::condition_variable ready, canRead;
+};
+
+// Hands the output frames out to the workers in order and keeps track of the ones still being worked on
+class Schedule {
+public:
+    int claim() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        inFlight.insert(next);
+        return next++;
+    }
+
+    // Returns the lowest frame still in flight, or the next one to hand out if there is none. No frame before it will be requested again.
+    int finish(const int n) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        inFlight.erase(n);
+        return inFlight.empty() ? next : *inFlight.begin();
+    }
+
+private:
+    std::set<int> inFlight;
+    int next = 0;
+    std::mutex mutex;
+};
+
+// Puts the frames finished by the workers back in order for the writer, and recycles their buffers
+class OrderedOutput {
+public:
+    OrderedOutput(const int workers, const int size) noexcept : active(workers), capacity(size) {}
+
+    std::unique_ptr<TDMBuffer> acquire() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        if (spare.empty())
+            return nullptr;
+        std::unique_ptr<TDMBuffer> frame = std::move(spare.back());
+        spare.pop_back();
+        return frame;
+    }
+
+    void recycle(std::unique_ptr<TDMBuffer> frame) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        spare.push_back(std::move(frame));
+    }
+
+    // Blocks until frame n is close enough to the next frame to write. Returns false once aborted.
+    bool put(const int n, std::unique_ptr<TDMBuffer> frame) {
+        std::unique_lock<std::mutex> lock{ mutex };
+        canPut.wait(lock, [&] { return aborted || n < next + capacity; });
+        if (aborted)
+            return false;
+        frames.emplace(n, std::move(frame));
+        ready.notify_all();
+        return true;
+    }
+
+    // Called by each worker when it has no frames left
+    void done() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        active--;
+        ready.notify_all();
+    }
+
+    // Returns false once every frame was taken or on abort
+    bool take(std::unique_ptr<TDMBuffer> & frame) {
+        std::unique_lock<std::mutex> lock{ mutex };
+        ready.wait(lock, [&] { return aborted || frames.count(next) || !active; });
+        auto iter = frames.find(next);
+        if (aborted || iter == frames.end())
+            return false;
+        frame = std::move(iter->second);
+        frames.erase(iter);
+        next++;
+        canPut.notify_all();
+        return true;
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        aborted = true;
+        ready.notify_all();
+        canPut.notify_all();
+    }
+
+private:
+    std::map<int, std::unique_ptr<TDMBuffer>> frames;
+    std::vector<std::unique_ptr<TDMBuffer>> spare;
+    int active, next = 0;
+    const int capacity;
+    bool aborted = false;
+    std::mutex mutex;
+    std::condition_variable ready, canPut;
+};
+
+struct Y4MHeader {
+    int width, height, numPlanes, bitsPerSample, subSamplingW, subSamplingH, order;
+    bool gray;
+    long long fpsNum, fpsDen;
+    std::string extra;
+};
+
+static std::string readLine(FILE * file, bool * eof) {
+    std::string line;
+    int c;
+    while ((c = fgetc(file)) != EOF && c != '\n') {
+        line += static_cast<char>(c);
+        if (line.size() > 4096)
+            throw std::string{ "header line too long" };
+    }
+    *eof = (c == EOF);
+    return line;
+}
+
+static void parseColorspace(const std::string & cs, Y4MHeader * h) {
+    static const struct {
+        const char * name;
+        int subSamplingW, subSamplingH;
+        bool gray;
+    } families[] = { { "420", 1, 1, false }, { "422", 1, 0, false }, { "444", 0, 0, false }, { "mono", 0, 0, true } };
+
+    for (const auto & family : families) {
+        const size_t len = strlen(family.name);
+        if (cs.compare(0, len, family.name))
+            continue;
+
+        std::string depth = cs.substr(len);
+        if (depth.empty() || (!family.gray && (depth == "jpeg" || depth == "paldv" || depth == "mpeg2"))) {
+            h->bitsPerSample = 8;
+        } else {
+            if (!family.gray && depth[0] == 'p')
+                depth.erase(0, 1);
+            if (depth.empty() || depth.find_first_not_of("0123456789") != std::string::npos)
+                break;
+            h->bitsPerSample = std::atoi(depth.c_str());
+        }
+
+        h->numPlanes = family.gray ? 1 : 3;
+        h->subSamplingW = family.subSamplingW;
+        h->subSamplingH = family.subSamplingH;
+        h->gray = family.gray;
+        if (h->bitsPerSample >= 8 && h->bitsPerSample <= 16)
+            return;
+        break;
+    }
+
+    throw std::string{ "unsupported colorspace " + cs };
+}
+
+static Y4MHeader readHeader(FILE * file) {
+    bool eof;
+    const std::string line = readLine(file, &eof);
+    if (line.compare(0, 10, "YUV4MPEG2 "))
+        throw std::string{ "the input is not a YUV4MPEG2 stream" };
+
+    Y4MHeader h{};
+    h.width = h.height = -1;
+    h.order = -1;
+    h.fpsNum = 25;
+    h.fpsDen = 1;
+    parseColorspace("420jpeg", &h);
+
+    size_t pos = 10;
+    while (pos < line.size()) {
+        size_t end = line.find(' ', pos);
+        if (end == std::string::npos)
+            end = line.size();
+        const std::string token = line.substr(pos, end - pos);
+        pos = end + 1;
+        if (token.empty())
+            continue;
+
+        const std::string value = token.substr(1);
+        switch (token[0]) {
+        case 'W':
+            h.width = std::atoi(value.c_str());
+            break;
+        case 'H':
+            h.height = std::atoi(value.c_str());
+            break;
+        case 'F':
+            if (std::sscanf(value.c_str(), "%lld:%lld", &h.fpsNum, &h.fpsDen) != 2 || h.fpsNum <= 0 || h.fpsDen <= 0)
+                throw std::string{ "invalid frame rate " + value };
+            break;
+        case 'I':
+            if (value == "t")
+                h.order = 1;
+            else if (value == "b")
+                h.order = 0;
+            break;
+        case 'C':
+            parseColorspace(value, &h);
+            h.extra += ' ' + token;
+            break;
+        default:
+            h.extra += ' ' + token;
+        }
+    }
+
+    if (h.width <= 0 || h.height <= 0)
+        throw std::string{ "the stream header lacks the frame dimensions" };
+
+    return h;
+}
+
+static void writeHeader(FILE * file, const Y4MHeader & h, const int mode) {
+    const long long fpsNum = (mode == 1) ? h.fpsNum * 2 : h.fpsNum;
+    if (std::fprintf(file, "YUV4MPEG2 W%d H%d F%lld:%lld Ip%s\n", h.width, h.height, fpsNum, h.fpsDen, h.extra.c_str()) < 0)
+        throw std::string{ "failed to write the output: " } + std::strerror(errno);
+}
+
+// Returns false at the end of the stream
+static bool readFrame(FILE * file, const TDMFrame & frame, const int numPlanes, const int bytesPerSample) {
+    bool eof;
+    const std::string line = readLine(file, &eof);
+    if (line.empty() && eof)
+        return false;
+    if (line.compare(0, 5, "FRAME"))
+        throw std::string{ "invalid frame header" };
+
+    for (int plane = 0; plane < numPlanes; plane++) {
+        const size_t rowSize = static_cast<size_t>(frame.width[plane]) * bytesPerSample;
+        uint8_t * ptr = frame.ptr[plane];
+        for (int y = 0; y < frame.height[plane]; y++) {
+            if (std::fread(ptr, 1, rowSize, file) != rowSize)
+                throw std::string{ "the last frame is truncated" };
+            ptr += frame.stride[plane];
+        }
+    }
+    return true;
+}
+
+static void writeFrame(FILE * file, const TDMFrame & frame, const int numPlanes, const int bytesPerSample) {
+    bool ok = std::fputs("FRAME\n", file) >= 0;
+    for (int plane = 0; plane < numPlanes && ok; plane++) {
+        const size_t rowSize = static_cast<size_t>(frame.width[plane]) * bytesPerSample;
+        const uint8_t * ptr = frame.ptr[plane];
+        for (int y = 0; y < frame.height[plane] && ok; y++) {
+            ok = std::fwrite(ptr, 1, rowSize, file) == rowSize;
+            ptr += frame.stride[plane];
+        }
+    }
+    if (!ok)
+        throw std::string{ "failed to write the output: " } + std::strerror(errno);
+}
+
+static int parseInt(const std::string & name, const std::string & value) {
+    char * end;
+    errno = 0;
+    const long result = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end || errno || result < INT_MIN || result > INT_MAX)
+        throw std::string{ "invalid value for " + name + ": " + value };
+    return static_cast<int>(result);
+}
+
+// Parses a comma separated list of integers
+static std::vector<int> parseList(const std::string & name, const std::string & value) {
+    std::vector<int> list;
+    for (size_t pos = 0; pos < value.size();) {
+        size_t end = value.find(',', pos);
+        if (end == std::string::npos)
+            end = value.size();
+        list.push_back(parseInt(name, value.substr(pos, end - pos)));
+        pos = end + 1;
+    }
+    return list;
+}
+
+// Copies the borders of every plane of a frame of the uncropped stream from src, leaving the picture inside them to the processor
+static void copyBorders(const TDMFrame & dst, const TDMFrame & src, const int * crop, const TDeintModCore * d) noexcept {
+    const int bytesPerSample = (d->bitsPerSample + 7) / 8;
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        const int ssW = plane ? d->subSamplingW : 0;
+        const int ssH = plane ? d->subSamplingH : 0;
+        const int rowSize = dst.width[plane] * bytesPerSample;
+        const int height = dst.height[plane];
+        const int left = (crop[0] >> ssW) * bytesPerSample;
+        const int right = (crop[1] >> ssW) * bytesPerSample;
+        const int top = crop[2] >> ssH;
+        const int bottom = crop[3] >> ssH;
+
+        const auto copy = [&](const int x, const int y, const int width, const int lines) {
+            if (width && lines)
+                tdmBitblt(dst.ptr[plane] + dst.stride[plane] * y + x, dst.stride[plane], src.ptr[plane] + src.stride[plane] * y + x, src.stride[plane],
+                          width, lines);
+        };
+
+        copy(0, 0, rowSize, top);
+        copy(0, height - bottom, rowSize, bottom);
+        copy(0, top, left, height - top - bottom);
+        copy(rowSize - right, top, right, height - top - bottom);
+    }
+}
+
+static bool parseBool(const std::string & name, const std::string & value) {
+    if (value == "true")
+        return true;
+    if (value == "false")
+        return false;
+    return !!parseInt(name, value);
+}
+
+static int run(int argc, char ** argv) {
+    TDeintModCore d{};
+    tdmSetDefaults(&d);
+
+    int threads = 0;
+
+    const std::pair<const char *, int *> intArgs[] = {
+        { "order", &d.order }, { "field", &d.field }, { "mode", &d.mode }, { "length", &d.length }, { "lookahead", &d.lookahead },
+        { "mtype", &d.mtype }, { "ttype", &d.ttype }, { "mtql", &d.mtqL }, { "mthl", &d.mthL }, { "mtqc", &d.mtqC }, { "mthc", &d.mthC },
+        { "nt", &d.nt }, { "minthresh", &d.minthresh }, { "maxthresh", &d.maxthresh }, { "cstr", &d.cstr }, { "mres", &d.mres }, { "athresh", &d.athresh },
+        { "metric", &d.metric }, { "expand", &d.expand }, { "type", &d.type }, { "opt", &d.opt },
+        { "threads", &threads }
+    };
+    const std::pair<const char *, bool *> boolArgs[] = { { "link", &d.link }, { "show", &d.show }, { "lumamask", &d.lumaMask }, { "reduce", &d.reduce } };
+
+    bool orderSet = false;
+    std::vector<int> planes, crop;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            std::fputs(usage, stdout);
+            return 0;
+        }
+
+        const size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+            throw std::string{ "arguments must be given as name=value: " + arg + "\n\n" + usage };
+        const std::string name = arg.substr(0, eq), value = arg.substr(eq + 1);
+
+        bool known = false;
+        for (const auto & intArg : intArgs) {
+            if (name == intArg.first) {
+                *intArg.second = parseInt(name, value);
+                known = true;
+            }
+        }
+        for (const auto & boolArg : boolArgs) {
+            if (name == boolArg.first) {
+                *boolArg.second = parseBool(name, value);
+                known = true;
+            }
+        }
+        if (name == "planes" || name == "crop") {
+            (name == "planes" ? planes : crop) = parseList(name, value);
+            known = true;
+        }
+        if (!known)
+            throw std::string{ "unknown parameter " + name };
+
+        orderSet |= (name == "order");
+    }
+
+    if (threads < 0)
+        throw std::string{ "threads must be greater than or equal to 0" };
+
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::setvbuf(stdin, nullptr, _IOFBF, 1 << 20);
+    std::setvbuf(stdout, nullptr, _IOFBF, 1 << 20);
+
+    const Y4MHeader h = readHeader(stdin);
+
+    // Like the plugin, the field order of the source takes precedence
+    if (h.order != -1)
+        d.order = h.order;
+    else if (!orderSet)
+        throw std::string{ "the stream doesn't specify its field order, so order must be given" };
+
+    d.width = h.width;
+    d.height = h.height;
+    d.numPlanes = h.numPlanes;
+    d.bitsPerSample = h.bitsPerSample;
+    d.subSamplingW = h.subSamplingW;
+    d.subSamplingH = h.subSamplingH;
+    d.gray = h.gray;
+
+    // the processor works on the picture inside the borders, while the frames read and written keep the dimensions of the stream
+    const bool hasCrop = !crop.empty();
+    if (hasCrop) {
+        if (crop.size() != 4)
+            throw std::string{ "crop must have four values: left, right, top and bottom" };
+        tdmSetCrop(&d, crop.data());
+    }
+
+    tdmInit(&d);
+
+    for (int i = 0; i < 3; i++)
+        d.process[i] = planes.empty();
+
+    for (const int n : planes) {
+        if (n < 0 || n >= d.numPlanes)
+            throw std::string{ "plane index out of range" };
+
+        if (d.process[n])
+            throw std::string{ "plane specified twice" };
+
+        d.process[n] = true;
+    }
+
+    const int bytesPerSample = (d.bitsPerSample + 7) / 8;
+    const auto newFrame = [&] { return std::unique_ptr<TDMBuffer>{ new TDMBuffer{ h.width, h.height, d.numPlanes, bytesPerSample, d.subSamplingW, d.subSamplingH } }; };
+
+    if (threads == 0)
+        threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+    SourceWindow window{ 2 };
+    Schedule schedule;
+    OrderedOutput output{ threads, threads * 2 };
+
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    const auto fail = [&] {
+        {
+            std::lock_guard<std::mutex> lock{ errorMutex };
+            if (!error)
+                error = std::current_exception();
+        }
+        window.abort();
+        output.abort();
+    };
+
+    writeHeader(stdout, h, d.mode);
+
+    std::thread reader{ [&] {
+        try {
+            for (;;) {
+                std::shared_ptr<TDMBuffer> frame = newFrame();
+                if (!readFrame(stdin, frame->frame(), d.numPlanes, bytesPerSample) || !window.push(std::move(frame)))
+                    break;
+            }
+            window.finish();
+        } catch (...) {
+            fail();
+        }
+    } };
+
+    TDeintModProcessor processor{ d, unknownLength, [&](const int n) {
+        if (!window.wait(n))
+            throw std::string{ "frame " + std::to_string(n) + " is past the end of the stream" };
+        const std::shared_ptr<TDMBuffer> frame = window.get(n);
+        if (!hasCrop)
+            return std::shared_ptr<const TDMFrame>{ frame, &frame->frame() };
+
+        // the view is kept alive together with the frame it points into
+        const auto view = std::make_shared<std::pair<std::shared_ptr<TDMBuffer>, TDMFrame>>(frame, tdmCropView(&d, frame->frame(), crop.data()));
+        return std::shared_ptr<const TDMFrame>{ view, &view->second };
+    } };
+
+    // The workers take the frames in order, and once a frame is done what only the frames before the lowest one still in flight need
+    // is dropped
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < threads; worker++) {
+        workers.emplace_back([&] {
+            try {
+                for (;;) {
+                    const int n = schedule.claim();
+
+                    // Everything getFrame may read has to be available, which is also how the end of the stream is found
+                    while (!window.wait(processor.lastSourceFrame(n))) {
+                        if (!window.length())
+                            throw std::string{ "the stream has no frames" };
+                        processor.setNumFrames(window.length());
+                    }
+
+                    if (n >= processor.numOutputFrames())
+                        break;
+
+                    std::unique_ptr<TDMBuffer> frame = output.acquire();
+                    if (!frame)
+                        frame = newFrame();
+                    if (hasCrop) {
+                        copyBorders(frame->frame(), window.get((d.mode == 1) ? n / 2 : n)->frame(), crop.data(), &d);
+                        processor.getFrame(n, tdmCropView(&d, frame->frame(), crop.data()));
+                    } else {
+                        processor.getFrame(n, frame->frame());
+                    }
+                    if (!output.put(n, std::move(frame)))
+                        break;
+
+                    window.release(processor.release(schedule.finish(n)));
+                }
+            } catch (...) {
+                fail();
+            }
+            output.done();
+        });
+    }
+
+    try {
+        std::unique_ptr<TDMBuffer> frame;
+        while (output.take(frame)) {
+            writeFrame(stdout, frame->frame(), d.numPlanes, bytesPerSample);
+            output.recycle(std::move(frame));
+        }
+        if (std::fflush(stdout))
+            throw std::string{ "failed to write the output: " } + std::strerror(errno);
+    } catch (...) {
+        fail();
+    }
+
+    for (auto & worker : workers)
+        worker.join();
+    window.abort();
+    reader.join();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    try {
+        return run(argc, argv);
+    } catch (const std::string & error) {
+        std::fprintf(stderr, "tdm: %s\n", error.c_str());
+        return 1;
+    }
+}
@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+"""End-to-end throughput benchmark for tdm.TDeintMod and tdm.IsCombed.
+
+Runs the filters through a VapourSynth core on synthetic interlaced content and reports fps and peak RSS, so changes
+to the internal graph (caches, copies, request fan-out) show up as a single reproducible number. With --trace the
+filter activations per output frame are counted from the trace of TDeintMod, which shows how much work the graph
+does per frame regardless of the thread count. Every configuration runs in a fresh process so that peak RSS is per
+configuration.
+
+The source is served by a Python ModifyFrame callback, which holds the GIL, so at high thread counts the source
+itself can become the bottleneck. Compare against the 'source' row before reading the fps of the filters.
+
+    python3 benchmark/benchmark.py --threads 1 8 --frames 1000 --json results.json
+"""
+
+import argparse
+import json
+import os
+import random
+import resource
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+def synthetic_clip(core, vs, args):
+    """Interlaced clip of a textured background panning at args.motion pixels per field, with a static
+    rectangle covering args.static of the width and args.combing of the frames woven from two instants."""
+    rng = random.Random(args.seed)
+    fmt = vs.YUV420P8 if args.bits == 8 else core.register_format(vs.YUV, vs.INTEGER, args.bits, 1, 1).id
+    peak = (1 << args.bits) - 1
+    width, height, unique = args.width, args.height, args.unique
+
+    # Random blocks smoothed into a texture wide enough to pan across for the whole loop
+    block = 32
+    columns = (width + int(args.motion * unique * 2) + 2) // block + 1
+    rows = []
+    for _ in range(height // block + 1):
+        row = [core.std.BlankClip(width=block, height=block, format=fmt, length=1,
+                                  color=[rng.randint(0, peak), rng.randint(0, peak), rng.randint(0, peak)])
+               for _ in range(columns)]
+        rows.append(core.std.StackHorizontal(row))
+    blocks = core.std.StackVertical(rows)
+    texture = blocks.resize.Bicubic(width=blocks.width // 4, height=blocks.height // 4).resize.Bicubic(width=blocks.width, height=height)
+
+    # One progressive frame per field, cropped at even offsets to keep the chroma aligned
+    offsets = [int(args.motion * t) // 2 * 2 for t in range(unique * 2)]
+    instants = [texture.std.Crop(left=x, right=texture.width - width - x) for x in offsets]
+    progressive = core.std.Splice(instants)
+
+    if args.static > 0:
+        static_width = max(int(width * args.static) // 4 * 4, 4)
+        still = instants[0] * progressive.num_frames
+        mask = core.std.BlankClip(width=static_width, height=height, format=fmt, length=progressive.num_frames,
+                                  color=[peak, peak, peak])
+        if static_width < width:
+            mask = mask.std.AddBorders(right=width - static_width, color=[0, 0, 0])
+        progressive = core.std.MaskedMerge(progressive, still, mask)
+
+    # Top field from the first instant and bottom field from the second, or both from the first when not combed
+    fields = progressive.std.SeparateFields(tff=True)
+    interlaced = fields.std.SelectEvery(4, [0, 3]).std.DoubleWeave(tff=True)[::2]
+    woven = progressive[::2]
+    frames = []
+    acc = 0.
+    for n in range(unique):
+        acc += args.combing
+        if acc >= 1.:
+            acc -= 1.
+            frames.append(interlaced[n])
+        else:
+            frames.append(woven[n])
+    clip = core.std.Splice(frames)
+    return core.std.SetFrameProp(clip, prop='_FieldBased', intval=2)
+
+
+def build(core, vs, args, config, trace=None):
+    pattern = synthetic_clip(core, vs, args)
+
+    # Render the loop once so that generating the source costs next to nothing during the measurement
+    rendered = [pattern.get_frame(n) for n in range(pattern.num_frames)]
+    blank = core.std.BlankClip(pattern, length=args.frames)
+    src = core.std.ModifyFrame(blank, blank, lambda n, f: rendered[n % len(rendered)])
+
+    filt = config['filter']
+    if filt == 'source':
+        return src
+    if filt == 'IsCombed':
+        return core.tdm.IsCombed(src)
+
+    kwargs = dict(order=1, mode=config['mode'], length=config['length'])
+    if config.get('stats'):
+        kwargs['stats'] = True
+    if trace:
+        kwargs['trace'] = trace
+    if config['edeint']:
+        separated = src.std.SeparateFields(tff=True)
+        if config['mode'] == 0:
+            separated = separated[::2]
+        kwargs['edeint'] = separated.resize.Spline36(height=src.height)
+    return core.tdm.TDeintMod(src, **kwargs)
+
+
+def run_one(args, config):
+    import vapoursynth as vs
+    core = vs.core if hasattr(vs, 'core') else vs.get_core()
+    core.num_threads = config['threads']
+    if args.cache_mb:
+        core.max_cache_size = args.cache_mb
+
+    logs = []
+    handler = lambda level, msg: logs.append(msg)
+    if hasattr(core, 'add_log_handler'):
+        core.add_log_handler(handler)
+    elif hasattr(vs, 'set_message_handler'):
+        vs.set_message_handler(handler)
+
+    trace = None
+    if args.trace and config['filter'] == 'TDeintMod':
+        fd, trace = tempfile.mkstemp(suffix='.json')
+        os.close(fd)
+
+    clip = build(core, vs, args, config, trace)
+    prefetch = args.prefetch or config['threads']
+
+    lock = threading.Condition()
+    state = dict(next=0, done=0, error=None)
+    latency = [0.] * clip.num_frames
+
+    def request():
+        n = state['next']
+        state['next'] += 1
+        start = time.perf_counter()
+        fut = clip.get_frame_async(n)
+        fut.add_done_callback(lambda f, n=n, start=start: finished(f, n, start))
+
+    def finished(fut, n, start):
+        with lock:
+            latency[n] = time.perf_counter() - start
+            state['done'] += 1
+            if fut.exception() is not None and state['error'] is None:
+                state['error'] = fut.exception()
+            if state['next'] < clip.num_frames and state['error'] is None:
+                request()
+            lock.notify()
+
+    start = time.perf_counter()
+    with lock:
+        for _ in range(min(prefetch, clip.num_frames)):
+            request()
+        while state['done'] < state['next'] or (state['next'] < clip.num_frames and state['error'] is None):
+            lock.wait()
+    elapsed = time.perf_counter() - start
+
+    if state['error'] is not None:
+        raise state['error']
+
+    # The trace is written when the filters are freed
+    del clip
+    result = dict(config)
+    result.update(
+        frames=state['done'],
+        fps=state['done'] / elapsed,
+        latency_ms=1000. * sum(latency) / max(state['done'], 1),
+        peak_rss_mb=resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024.,
+    )
+    if trace:
+        result.update(count_activations(trace, state['done']))
+        os.remove(trace)
+    stats = [m for m in logs if m.startswith('TDeintMod: ') and 'motion mask fields computed' in m]
+    if stats:
+        result['stats'] = stats[-1]
+    return result
+
+
+def count_activations(path, frames):
+    """Activations of all the filters of the graph and motion mask fields computed, both per output frame, from a
+    TDeintMod trace."""
+    with open(path) as f:
+        events = json.load(f)['traceEvents']
+    spans = [e for e in events if e.get('ph') == 'X']
+    computed = sum(1 for e in spans if e['name'].startswith('CreateMM') and e['cat'] == 'compute')
+    return dict(activations=len(spans) / max(frames, 1), mask_fields=computed / max(frames, 1))
+
+
+def configurations(args):
+    for threads in args.threads:
+        yield dict(filter='source', threads=threads)
+        yield dict(filter='IsCombed', threads=threads)
+        for mode in args.modes:
+            for length in args.lengths:
+                for edeint in (False, True):
+                    yield dict(filter='TDeintMod', mode=mode, length=length, edeint=edeint, threads=threads, stats=args.stats)
+
+
+def describe(config):
+    if config['filter'] != 'TDeintMod':
+        return config['filter']
+    return 'TDeintMod mode={} length={}{}'.format(config['mode'], config['length'], ' edeint' if config['edeint'] else '')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--threads', type=int, nargs='+', default=[1, os.cpu_count() or 1])
+    parser.add_argument('--modes', type=int, nargs='+', default=[0, 1])
+    parser.add_argument('--lengths', type=int, nargs='+', default=[6, 10, 20])
+    parser.add_argument('--frames', type=int, default=500, help='frames requested per configuration')
+    parser.add_argument('--width', type=int, default=1920)
+    parser.add_argument('--height', type=int, default=1080)
+    parser.add_argument('--bits', type=int, default=8)
+    parser.add_argument('--unique', type=int, default=60, help='length of the rendered loop')
+    parser.add_argument('--motion', type=float, default=2., help='pan speed in pixels per field')
+    parser.add_argument('--static', type=float, default=.25, help='fraction of the width that never moves')
+    parser.add_argument('--combing', type=float, default=1., help='fraction of frames woven from two instants')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--prefetch', type=int, default=0, help='requests kept outstanding, 0 = number of threads')
+    parser.add_argument('--cache-mb', type=int, default=0, help='core cache size in MB, 0 = default')
+    parser.add_argument('--stats', action='store_true', help='also report the TDeintMod stats summary')
+    parser.add_argument('--trace', action='store_true',
+                        help='count the filter activations and motion mask fields per output frame from a TDeintMod trace, '
+                             'which costs some fps')
+    parser.add_argument('--json', help='write the results to this file')
+    parser.add_argument('--run-one', help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.run_one:
+        payload = json.loads(args.run_one)
+        print(json.dumps(run_one(argparse.Namespace(**payload['settings']), payload['config'])))
+        return
+
+    settings = {k: v for k, v in vars(args).items() if k not in ('json', 'run_one')}
+    results = []
+    print('{:<36} {:>7} {:>9} {:>11} {:>13} {:>12} {:>12}'.format('configuration', 'threads', 'fps', 'latency ms', 'peak RSS MB',
+                                                                 'activations', 'mask fields'))
+    for config in configurations(args):
+        payload = json.dumps(dict(settings=settings, config=config))
+        proc = subprocess.run([sys.executable, __file__, '--run-one', payload], stdout=subprocess.PIPE, universal_newlines=True)
+        if proc.returncode:
+            print('{:<36} {:>7} failed'.format(describe(config), config['threads']))
+            continue
+        result = json.loads(proc.stdout.strip().splitlines()[-1])
+        results.append(result)
+        per_frame = ['{:>12.2f}'.format(result[key]) if key in result else '{:>12}'.format('-') for key in ('activations', 'mask_fields')]
+        print('{:<36} {:>7} {:>9.2f} {:>11.2f} {:>13.1f} {} {}'.format(
+            describe(config), config['threads'], result['fps'], result['latency_ms'], result['peak_rss_mb'], *per_frame))
+        if 'stats' in result:
+            print('    ' + result['stats'])
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(dict(settings=settings, results=results), f, indent=2)
+
+
+if __name__ == '__main__':
+    main()